@@ -0,0 +1,9 @@
+// Per-CPU scheduler statistics, as returned by cpustat().
+struct cpustat {
+  int cpu;          // Hart id
+  int runqlen;      // Processes waiting in this CPU's run queue
+  uint64 nsteal;    // Processes taken from other CPUs' run queues
+  uint64 nmigrate;  // Processes run here after last running elsewhere
+  uint64 busy;      // Timer cycles spent running or scheduling
+  uint64 idle;      // Timer cycles spent waiting for work
+};
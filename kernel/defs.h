@@ -2,12 +2,15 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct memstat;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct slabcache;
 struct stat;
 struct superblock;
+struct vma;
 
 // bio.c
 void            binit(void);
@@ -24,6 +27,7 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+void            execinit(void);
 
 // file.c
 struct file*    filealloc(void);
@@ -33,6 +37,9 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             vmaload(struct vma*, uint64, char*);
+void            vmawrite(struct inode*, char*, uint, uint);
+void            freevmas(struct vma*);
 
 // fs.c
 void            fsinit(int);
@@ -62,7 +69,12 @@ void            ramdiskrw(struct buf*);
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
+void            kdup(void *);
+int             krefs(void *);
+void*           kallocpages(int);
+void            kfreepages(void *, int);
 void            kinit(void);
+void            memstat(struct memstat*);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -71,6 +83,7 @@ void            begin_op(void);
 void            end_op(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -83,25 +96,45 @@ void            printfinit(void);
 
 // proc.c
 int             cpuid(void);
+int             cpustat(uint64, int);
+int             vmfault(pagetable_t, uint64, int);
+uint64          vmpin(pagetable_t, uint64, int);
+uint64          mmap(struct vma*);
+int             munmap(uint64, uint64);
+int             getrusage(int, uint64);
+int             times(uint64);
 void            exit(int);
 int             fork(void);
+int             clone(uint64, uint64, uint64);
+int             join(int);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
 int             killed(struct proc*);
+void            killthreads(struct proc*);
 void            setkilled(struct proc*);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
 void            procinit(void);
+void            preempt(void);
+void            dlthrottle(void);
+void            resched(void);
+int             setpriority(int, int);
+int             getpriority(int);
+int             settickets(int);
+int             setdeadline(int, int, int);
+int             dlyield(void);
+int             setaffinity(int, int);
+int             getaffinity(int);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+int             futex(uint64, int, int);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
@@ -110,6 +143,11 @@ void            procdump(void);
 // swtch.S
 void            swtch(struct context*, struct context*);
 
+// slab.c
+void            slabinit(struct slabcache*, char*, int);
+void*           slaballoc(struct slabcache*);
+void            slabfree(struct slabcache*, void*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
@@ -147,6 +185,18 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            settimer(uint64);
+int             sleepuntil(uint64);
+void            ipi(int);
+
+// trace.c
+void            traceinit(void);
+void            tracerec(int, int, int);
+int             traceset(int);
+int             tracedrain(uint64, int);
+void            profrec(void);
+int             profset(int);
+int             profdrain(uint64, int);
 
 // uart.c
 void            uartinit(void);
@@ -159,6 +209,8 @@ int             uartgetc(void);
 void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
+int             kvmmapstack(uint64, uint64);
+void            kvmunmapstack(uint64);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvmfirst(pagetable_t, uchar *, uint);
@@ -168,11 +220,16 @@ int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+void            uvmrevoke(pagetable_t, uint64, uint64);
+uint64          walkskip(pagetable_t, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             uvmdemand(pagetable_t, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
+void            prefault(pagetable_t, uint64, uint64, int);
 
 // plic.c
 void            plicinit(void);
@@ -3,11 +3,23 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "slab.h"
+#include "fs.h"
+#include "file.h"
 #include "defs.h"
 #include "elf.h"
+#include "mman.h"
 
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
+// buffers for sys_exec() to copy arguments into.
+struct slabcache argcache;
+
+void
+execinit(void)
+{
+  slabinit(&argcache, "execarg", MAXARGLEN);
+}
 
 int flags2perm(int flags)
 {
@@ -23,14 +35,20 @@ int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nvma = 0;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
+  struct vma vma[NVMA];
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
+  // only the process that leads a group of threads
+  // can replace their shared image.
+  if(p->leader != p)
+    return -1;
+
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -49,7 +67,9 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Map the program's segments, to be read in a page at a
+  // time as they are touched; see vmfault().
+  memset(vma, 0, sizeof(vma));
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -61,12 +81,23 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
+    // leave room for the stack pages below the space
+    // mmap() and clone() use.
+    if(ph.vaddr < sz || ph.vaddr + ph.memsz > MMAPTOP - 2*PGSIZE)
+      goto bad;
+    if(ph.off + ph.filesz < ph.off || ph.off + ph.filesz > ip->size)
       goto bad;
-    sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nvma >= NVMA)
       goto bad;
+    vma[nvma].start = ph.vaddr;
+    vma[nvma].end = PGROUNDUP(ph.vaddr + ph.memsz);
+    vma[nvma].ip = idup(ip);
+    vma[nvma].off = ph.off;
+    vma[nvma].filesz = ph.filesz;
+    vma[nvma].perm = flags2perm(ph.flags);
+    vma[nvma].flags = MAP_PRIVATE;
+    nvma++;
+    sz = ph.vaddr + ph.memsz;
   }
   iunlockput(ip);
   end_op();
@@ -120,10 +151,15 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
-  // Commit to the user image.
+  // Commit to the user image, ending any threads
+  // that share the old one.
+  killthreads(p);
+  munmap(0, MAXVA);
+  memmove(p->vma, vma, sizeof(vma));
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->heapbase = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
@@ -137,30 +173,10 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
-  return -1;
-}
-
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
-{
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
+  if(nvma > 0){
+    begin_op();
+    freevmas(vma);
+    end_op();
   }
-  
-  return 0;
+  return -1;
 }
@@ -8,21 +8,23 @@
 #include "param.h"
 #include "fs.h"
 #include "spinlock.h"
+#include "slab.h"
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
 
 struct devsw devsw[NDEV];
+// files' reference counts are changed atomically, without
+// a lock: each read() or write() takes a reference.
 struct {
-  struct spinlock lock;
-  struct file file[NFILE];
+  struct slabcache cache;
 } ftable;
 
 void
 fileinit(void)
 {
-  initlock(&ftable.lock, "ftable");
+  slabinit(&ftable.cache, "file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -31,27 +33,18 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = slaballoc(&ftable.cache)) == 0)
+    return 0;
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
 struct file*
 filedup(struct file *f)
 {
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  if(__sync_fetch_and_add(&f->ref, 1) < 1)
     panic("filedup");
-  f->ref++;
-  release(&ftable.lock);
   return f;
 }
 
@@ -60,18 +53,14 @@ void
 fileclose(struct file *f)
 {
   struct file ff;
+  int n;
 
-  acquire(&ftable.lock);
-  if(f->ref < 1)
-    panic("fileclose");
-  if(--f->ref > 0){
-    release(&ftable.lock);
+  if((n = __sync_sub_and_fetch(&f->ref, 1)) > 0)
     return;
-  }
+  if(n < 0)
+    panic("fileclose");
   ff = *f;
-  f->ref = 0;
-  f->type = FD_NONE;
-  release(&ftable.lock);
+  slabfree(&ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -118,6 +107,7 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
+    prefault(myproc()->pagetable, addr, n, 1);
     ilock(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
@@ -159,6 +149,7 @@ filewrite(struct file *f, uint64 addr, int n)
       if(n1 > max)
         n1 = max;
 
+      prefault(myproc()->pagetable, addr + i, n1, 0);
       begin_op();
       ilock(f->ip);
       if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
@@ -180,3 +171,68 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+
+// Fill mem with the page of region v at va: the bytes of
+// v's file that fall in it, and zeroes after them. Locks
+// v's file, so the caller must hold no spinlocks nor (see
+// prefault()) inode locks. Returns 0, or -1 if the file
+// could not be read.
+int
+vmaload(struct vma *v, uint64 va, char *mem)
+{
+  uint64 off;
+  uint n = 0;
+  int r = 0;
+
+  off = va - v->start;
+  if(off < v->filesz)
+    n = v->filesz - off < PGSIZE ? v->filesz - off : PGSIZE;
+  memset(mem + n, 0, PGSIZE - n);
+  if(n == 0)
+    return 0;
+  ilock(v->ip);
+  if(readi(v->ip, 0, (uint64)mem, v->off + off, n) != n)
+    r = -1;
+  iunlock(v->ip);
+  return r;
+}
+
+// Write n bytes of a page of a MAP_SHARED region, at mem,
+// back to ip at off, in as many transactions as filewrite()
+// would use. Bytes past the file's current end are dropped,
+// since a mapping cannot grow its file.
+void
+vmawrite(struct inode *ip, char *mem, uint off, uint n)
+{
+  uint max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint i, n1;
+
+  for(i = 0; i < n; i += n1){
+    n1 = n - i < max ? n - i : max;
+    begin_op();
+    ilock(ip);
+    if(off + i + n1 > ip->size)
+      n1 = off + i < ip->size ? ip->size - (off + i) : 0;
+    if(n1 > 0)
+      writei(ip, 0, (uint64)(mem + i), off + i, n1);
+    iunlock(ip);
+    end_op();
+    if(n1 == 0)
+      break;
+  }
+}
+
+// Drop the file references held by an array of NVMA
+// regions, and clear it. Must be called in a transaction,
+// in case a reference is the file's last.
+void
+freevmas(struct vma *vma)
+{
+  struct vma *v;
+
+  for(v = vma; v < &vma[NVMA]; v++){
+    if(v->ip)
+      iput(v->ip);
+    memset(v, 0, sizeof(*v));
+  }
+}
@@ -17,6 +17,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "sleeplock.h"
+#include "slab.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
@@ -130,11 +131,13 @@ bfree(int dev, uint b)
 //   the reference and link counts have fallen to zero.
 //
 // * Referencing in table: an entry in the inode table
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
+//   is unused if ip->ref is zero. Otherwise ip->ref tracks
 //   the number of in-memory pointers to the entry (open
 //   files and current directories). iget() finds or
 //   creates a table entry and increments its ref; iput()
-//   decrements ref.
+//   decrements ref. Entries come from a slab cache, and
+//   iput() frees an unused one unless fewer than NINODE
+//   are being kept for reuse.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
@@ -175,18 +178,16 @@ bfree(int dev, uint b)
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *head;      // all entries, linked through next
+  int nidle;               // entries with ref == 0
+  struct slabcache cache;
 } itable;
 
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
-  }
+  slabinit(&itable.cache, "inode", sizeof(struct inode));
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -246,27 +247,33 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = itable.head; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        itable.nidle--;
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
+  if((ip = slaballoc(&itable.cache)) != 0){
+    initsleeplock(&ip->lock, "inode");
+    ip->next = itable.head;
+    itable.head = ip;
+  } else {
+    // Out of memory: recycle an unused entry.
+    for(ip = itable.head; ip && ip->ref > 0; ip = ip->next)
+      ;
+    if(ip == 0)
+      panic("iget: no inodes");
+    itable.nidle--;
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
@@ -336,6 +343,8 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+  struct inode **ipp;
+
   acquire(&itable.lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
@@ -357,7 +366,16 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    if(itable.nidle < NINODE){
+      itable.nidle++;
+    } else {
+      for(ipp = &itable.head; *ipp != ip; ipp = &(*ipp)->next)
+        ;
+      *ipp = ip->next;
+      slabfree(&itable.cache, ip);
+    }
+  }
   release(&itable.lock);
 }
 
@@ -652,11 +670,17 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  struct proc *l;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(myproc()->cwd);
+  else {
+    // a thread's working directory is its leader's.
+    l = myproc()->leader;
+    acquire(&l->filelock);
+    ip = idup(l->cwd);
+    release(&l->filelock);
+  }
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
@@ -1,12 +1,15 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. A buddy allocator hands out
+// physically contiguous blocks of 4096 << order bytes;
+// kalloc() and kfree() deal in single pages.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "memstat.h"
 #include "defs.h"
 
 void freerange(void *pa_start, void *pa_end);
@@ -14,19 +17,54 @@ void freerange(void *pa_start, void *pa_end);
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// a free page or block. Only buddy free lists use prev.
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
+// page number, counting from KERNBASE, of pa.
+#define PGNUM(pa)   (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define NPAGES      PGNUM(PHYSTOP)
+
+// the buddy allocator. Free blocks of each order are on a
+// circular list, and a block's buddy is the block of the
+// same order whose page number differs only in bit order.
+// Page numbers count from KERNBASE, so a block is aligned
+// to its size in physical memory too.
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run free[NORDER];   // list heads
+  uchar order[NPAGES];       // order+1 of a free block starting here, else 0
+  int ref[NPAGES];           // kfree()s left before a kalloc() page is free
+  uint64 total;              // pages handed to the allocator
 } kmem;
 
+// Each CPU keeps a cache of free pages that normally only
+// it touches, refilled from and drained to the buddy
+// allocator KBATCH pages at a time, so that most kalloc()
+// and kfree() calls take no contended lock. A CPU whose
+// cache is empty when the buddy allocator is too steals
+// from the other CPUs' caches.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+};
+
+struct kcache kcaches[NCPU];
+
 void
 kinit()
 {
+  struct kcache *c;
+  int k;
+
   initlock(&kmem.lock, "kmem");
+  for(k = 0; k < NORDER; k++)
+    kmem.free[k].next = kmem.free[k].prev = &kmem.free[k];
+  for(c = kcaches; c < &kcaches[NCPU]; c++)
+    initlock(&c->lock, "kcache");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,31 +73,211 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kmem.total++;
+    kmem.ref[PGNUM(p)] = 1;
     kfree(p);
+  }
+}
+
+// Put the free block r of order k on its list.
+// Caller must hold kmem.lock.
+static void
+bpush(struct run *r, int k)
+{
+  r->next = kmem.free[k].next;
+  r->prev = &kmem.free[k];
+  r->next->prev = r;
+  kmem.free[k].next = r;
+  kmem.order[PGNUM(r)] = k + 1;
+}
+
+// Take the free block r off its list.
+// Caller must hold kmem.lock.
+static void
+bremove(struct run *r)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  kmem.order[PGNUM(r)] = 0;
+}
+
+// Allocate a block of order k, splitting a larger one
+// if need be. Caller must hold kmem.lock.
+static struct run*
+bget(int k)
+{
+  struct run *r;
+  int j;
+
+  for(j = k; j < NORDER && kmem.free[j].next == &kmem.free[j]; j++)
+    ;
+  if(j == NORDER)
+    return 0;
+  r = kmem.free[j].next;
+  bremove(r);
+  // give back the upper halves of what we don't need.
+  while(j > k){
+    j--;
+    bpush((struct run*)((char*)r + (PGSIZE << j)), j);
+  }
+  return r;
+}
+
+// Free the block r of order k, merging it with its buddy
+// for as long as the buddy is free too.
+// Caller must hold kmem.lock.
+static void
+bput(struct run *r, int k)
+{
+  uint64 pn = PGNUM(r), bn;
+
+  for(; k < NORDER - 1; k++){
+    bn = pn ^ (1L << k);
+    if(bn + (1L << k) > NPAGES || kmem.order[bn] != k + 1)
+      break;
+    bremove((struct run*)(KERNBASE + bn * PGSIZE));
+    pn &= ~(1L << k);
+  }
+  bpush((struct run*)(KERNBASE + pn * PGSIZE), k);
+}
+
+// Allocate 4096 << order bytes of physically contiguous
+// memory, aligned to their size.
+// Returns 0 if the memory cannot be allocated.
+void *
+kallocpages(int order)
+{
+  struct run *r;
+
+  if(order < 0 || order >= NORDER)
+    return 0;
+  acquire(&kmem.lock);
+  r = bget(order);
+  release(&kmem.lock);
+
+  if(r)
+    memset((char*)r, 5, PGSIZE << order); // fill with junk
+  return (void*)r;
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Free memory returned by kallocpages(order).
+void
+kfreepages(void *pa, int order)
+{
+  if(((uint64)pa % (PGSIZE << order)) != 0 || (char*)pa < end ||
+     (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic("kfreepages");
+
+  // Fill with junk to catch dangling refs.
+  memset(pa, 1, PGSIZE << order);
+
+  acquire(&kmem.lock);
+  bput((struct run*)pa, order);
+  release(&kmem.lock);
+}
+
+// Add a reference to the page pa, which came from kalloc(),
+// so that it takes one more kfree() to free it. Lets page
+// tables share pages copy-on-write.
+void
+kdup(void *pa)
+{
+  __sync_fetch_and_add(&kmem.ref[PGNUM(pa)], 1);
+}
+
+// How many references there are to the page pa.
+int
+krefs(void *pa)
+{
+  return kmem.ref[PGNUM(pa)];
+}
+
+// Drop a reference to the page of physical memory pointed
+// at by pa, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last one.
+// (The exception is when initializing the allocator; see
+// kinit above.)
 void
 kfree(void *pa)
 {
+  struct kcache *c;
   struct run *r;
+  int i, n;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if((n = __sync_sub_and_fetch(&kmem.ref[PGNUM(pa)], 1)) > 0)
+    return;
+  if(n < 0)
+    panic("kfree: ref");
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
+  push_off();
+  c = &kcaches[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  if(++c->n > KCACHE){
+    // give a batch back for other CPUs to use.
+    acquire(&kmem.lock);
+    for(i = 0; i < KBATCH; i++){
+      r = c->freelist;
+      c->freelist = r->next;
+      bput(r, 0);
+    }
+    release(&kmem.lock);
+    c->n -= KBATCH;
+  }
+  release(&c->lock);
+  pop_off();
+}
+
+// Refill this CPU's empty cache c: a batch of pages from
+// the buddy allocator if it has any, else half the pages
+// of the first other CPU's cache that has some.
+// Caller must hold c->lock; releases it while stealing.
+static void
+refill(struct kcache *c)
+{
+  struct kcache *o;
+  struct run *stolen = 0, *r;
+  int n = 0;
+
   acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  for(; n < KBATCH && (r = bget(0)) != 0; n++){
+    r->next = c->freelist;
+    c->freelist = r;
+  }
   release(&kmem.lock);
+  c->n += n;
+  if(n)
+    return;
+
+  // holding two cache locks at once could deadlock
+  // against a CPU stealing from this one.
+  release(&c->lock);
+  for(o = kcaches; o < &kcaches[NCPU] && n == 0; o++){
+    if(o == c)
+      continue;
+    acquire(&o->lock);
+    for(; n < (o->n + 1) / 2; n++){
+      r = o->freelist;
+      o->freelist = r->next;
+      r->next = stolen;
+      stolen = r;
+    }
+    o->n -= n;
+    release(&o->lock);
+  }
+  acquire(&c->lock);
+  c->freelist = stolen;
+  c->n = n;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -68,15 +286,46 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
+  struct kcache *c;
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  c = &kcaches[cpuid()];
+  acquire(&c->lock);
+  if(c->freelist == 0)
+    refill(c);
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->n--;
+  }
+  release(&c->lock);
+  pop_off();
 
-  if(r)
+  if(r){
+    kmem.ref[PGNUM(r)] = 1;
     memset((char*)r, 5, PGSIZE); // fill with junk
+  }
   return (void*)r;
 }
+
+// Fill in *st with physical memory statistics.
+void
+memstat(struct memstat *st)
+{
+  struct kcache *c;
+  struct run *r;
+  int k;
+
+  st->cached = 0;
+  for(c = kcaches; c < &kcaches[NCPU]; c++)
+    st->cached += c->n;
+  acquire(&kmem.lock);
+  st->total = kmem.total;
+  for(k = 0; k < NORDER; k++){
+    st->nfree[k] = 0;
+    for(r = kmem.free[k].next; r != &kmem.free[k]; r = r->next)
+      st->nfree[k]++;
+  }
+  release(&kmem.lock);
+}
@@ -22,11 +22,14 @@ main()
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
+    traceinit();     // scheduler event tracing
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    execinit();      // exec argument cache
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -27,6 +27,7 @@
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid)) // software interrupt pending.
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
 
@@ -62,6 +63,17 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   mmap() regions, down from MMAPTOP
+//   THREADFRAME(NTHREAD-1)..THREADFRAME(1) (trapframes of threads)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// threads sharing a page table each need their own
+// trapframe: the first process has TRAPFRAME, and the
+// threads it creates take slots below it.
+#define THREADFRAME(i) (TRAPFRAME - (i)*PGSIZE)
+
+// mmap() puts regions in the highest free space below
+// this, and sbrk() can grow the heap up to the lowest.
+#define MMAPTOP THREADFRAME(NTHREAD-1)
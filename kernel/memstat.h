@@ -0,0 +1,8 @@
+#define NORDER 11  // buddy block sizes: PGSIZE << 0 .. NORDER-1
+
+// Physical memory statistics, as returned by memstat().
+struct memstat {
+  uint64 total;          // Pages the allocator manages
+  uint64 cached;         // Free pages held in per-CPU caches
+  uint64 nfree[NORDER];  // Free buddy blocks of each order
+};
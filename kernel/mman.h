@@ -0,0 +1,11 @@
+// prot for mmap()
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+#define PROT_EXEC     0x4
+
+// flags for mmap(): exactly one of MAP_SHARED and MAP_PRIVATE
+#define MAP_SHARED    0x01  // stores reach the file and other mappers
+#define MAP_PRIVATE   0x02  // stores are the process's own
+#define MAP_ANONYMOUS 0x20  // zeroed memory rather than a file
+
+#define MAP_FAILED    ((void*)-1)
@@ -1,8 +1,18 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
+#define IRQCPUS     0x1  // mask of CPUs that take device interrupts
+#define NPRIO         4  // scheduling priority levels, 0 is highest
+#define BOOSTTICKS   20  // ticks between scheduling priority boosts
+#define TICKCYCLES 1000000  // timer cycles per tick; about 1/10th second in qemu
+#define NTHREAD      16  // maximum threads sharing an address space
+#define NTRACE     1024  // scheduler trace events kept per CPU
+#define NPROF      1024  // profile samples kept per CPU
+#define KCACHE       64  // most free pages a CPU keeps for itself
+#define KBATCH       16  // pages moved at once to or from the global pool
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NVMA         16  // file-backed regions per address space
+#define NINODE       50  // unreferenced i-nodes kept in memory
+#define MAXARGLEN   512  // exec argument bytes, with nul, held in a slab object
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
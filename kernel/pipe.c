@@ -3,22 +3,43 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "slab.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
 
+// A pipe's buffer is part of the pipe, unless the kernel is
+// built with PIPEORDER; then it is PGSIZE << PIPEORDER bytes
+// from kallocpages(), so that bulk transfers sleep and wake
+// less, at the cost of that much memory for every pipe.
+#ifdef PIPEORDER
+#define PIPESIZE (PGSIZE << PIPEORDER)
+#else
 #define PIPESIZE 512
+#endif
 
 struct pipe {
   struct spinlock lock;
+#ifdef PIPEORDER
+  char *data;     // PIPESIZE bytes from kallocpages()
+#else
   char data[PIPESIZE];
+#endif
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+struct slabcache pipecache;
+
+void
+pipeinit(void)
+{
+  slabinit(&pipecache, "pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,8 +49,12 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)slaballoc(&pipecache)) == 0)
+    goto bad;
+#ifdef PIPEORDER
+  if((pi->data = kallocpages(PIPEORDER)) == 0)
     goto bad;
+#endif
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
@@ -46,8 +71,12 @@ pipealloc(struct file **f0, struct file **f1)
   return 0;
 
  bad:
+#ifdef PIPEORDER
+  if(pi && pi->data)
+    kfreepages(pi->data, PIPEORDER);
+#endif
   if(pi)
-    kfree((char*)pi);
+    slabfree(&pipecache, pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,7 +97,10 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+#ifdef PIPEORDER
+    kfreepages(pi->data, PIPEORDER);
+#endif
+    slabfree(&pipecache, pi);
   } else
     release(&pi->lock);
 }
@@ -79,6 +111,7 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
   int i = 0;
   struct proc *pr = myproc();
 
+  prefault(pr->pagetable, addr, n, 0);
   acquire(&pi->lock);
   while(i < n){
     if(pi->readopen == 0 || killed(pr)){
@@ -109,6 +142,7 @@ piperead(struct pipe *pi, uint64 addr, int n)
   struct proc *pr = myproc();
   char ch;
 
+  prefault(pr->pagetable, addr, n, 1);
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
     if(killed(pr)){
@@ -22,8 +22,13 @@ plicinithart(void)
   int hart = cpuid();
   
   // set enable bits for this hart's S-mode
-  // for the uart and virtio disk.
-  *(uint32*)PLIC_SENABLE(hart) = (1 << UART0_IRQ) | (1 << VIRTIO0_IRQ);
+  // for the uart and virtio disk, if it is one of
+  // IRQCPUS. processes can be pinned to the others
+  // with setaffinity() to keep interrupts away.
+  if(IRQCPUS & (1 << hart))
+    *(uint32*)PLIC_SENABLE(hart) = (1 << UART0_IRQ) | (1 << VIRTIO0_IRQ);
+  else
+    *(uint32*)PLIC_SENABLE(hart) = 0;
 
   // set this hart's S-mode priority threshold to 0.
   *(uint32*)PLIC_SPRIORITY(hart) = 0;
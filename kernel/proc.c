@@ -4,15 +4,41 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "cpustat.h"
+#include "futex.h"
+#include "resource.h"
+#include "trace.h"
+#include "mman.h"
+#include "memstat.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// Process structures are allocated on demand, a page's worth
+// at a time, up to NPROC. A freed one goes on the free list
+// rather than back to kalloc(), so a struct proc stays a
+// struct proc: code that finds one without holding its lock
+// (e.g. findproc()) can lock it and recheck it safely.
+// Lock order: p->lock, then ptable.lock.
+struct {
+  struct spinlock lock;
+  struct proc *all;   // Every proc allocated, through p->allnext.
+  struct proc *free;  // UNUSED procs, through p->nextfree.
+  int n;              // Number of procs allocated.
+} ptable;
 
 struct proc *initproc;
 
+// pids are handed out in increasing order, wrapping at
+// MAXPID and skipping those still in use. pidhash indexes
+// every allocated proc by pid, for findproc().
+// Lock order: p->lock, then pid_lock.
+#define MAXPID   32768
+#define NPIDHASH 1024
+#define PIDHASH(pid) ((pid) % NPIDHASH)
+
 int nextpid = 1;
+struct proc *pidhash[NPIDHASH];
 struct spinlock pid_lock;
 
 extern void forkret(void);
@@ -20,42 +46,60 @@ static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
+// processes in sleep(), hashed by wait channel, so that
+// wakeup() need not look at the whole process table.
+// Lock order: sq->lock, then p->lock.
+#define NSLEEPQ 64
+#define SLEEPQHASH(chan) ((((uint64)(chan)) >> 4) % NSLEEPQ)
+
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;
+} sleepq[NSLEEPQ];
+
+// futex() checks a user word and sleeps with the futex lock
+// for the word's channel held, and wakers take it too, so no
+// wakeup is lost. Channels are hashed as for sleep queues.
+// Lock order: futex lock, then sq->lock.
+struct spinlock futexlock[NSLEEPQ];
+
+// Processes in the deadline (EDF) class are queued here
+// rather than on a CPU's run queue, and any CPU runs the
+// one with the earliest deadline before anything else.
+// util is the sum of runtime/period over admitted
+// processes, in units of DLUNIT per CPU.
+// Lock order: p->lock, then dlq.lock.
+#define DLUNIT (1 << 20)
+
+struct {
+  struct spinlock lock;
+  struct proc *head;  // Earliest deadline first, through p->rqnext.
+  int len;
+  uint64 util;
+} dlq;
+
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
 // memory model when using p->parent.
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void
-proc_mapstacks(pagetable_t kpgtbl)
-{
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
-}
-
 // initialize the proc table.
 void
 procinit(void)
 {
-  struct proc *p;
+  struct cpu *c;
   
+  initlock(&ptable.lock, "ptable");
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->state = UNUSED;
-      p->kstack = KSTACK((int) (p - proc));
-  }
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    initlock(&c->rq.lock, "runq");
+  for(int i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
+  for(int i = 0; i < NSLEEPQ; i++)
+    initlock(&futexlock[i], "futex");
+  initlock(&dlq.lock, "dlq");
 }
 
 // Must be called with interrupts disabled,
@@ -89,41 +133,1230 @@ myproc(void)
   return p;
 }
 
+// Affinity masks have a bit per cpus[] index.
+#define ALLCPUS   ((1 << NCPU) - 1)
+#define CPUBIT(c) (1 << ((c) - cpus))
+
+// May p, queued on c, be taken to run on CPU to? A CPU
+// takes anything from its own run queue, and scheduler()
+// moves on a process whose affinity changed while queued;
+// another CPU must be in p's affinity mask. Reads
+// p->affinity without p->lock, so only a hint.
+#define canrun(p, c, to) ((to) == (c) || ((p)->affinity & CPUBIT(to)))
+
+// stride scheduling: tickets of a new process,
+// and the stride of a process holding one ticket.
+#define DEFTICKETS 100
+#define STRIDE1    (1 << 20)
+
+#ifdef SCHED_STRIDE
+
+// Stride scheduling. Each process holds tickets, and its
+// stride is inversely proportional to them. A process's pass
+// advances by its stride for every tick it runs, and each CPU
+// always runs its queued process with the smallest pass, so
+// over time processes on a CPU get CPU time in proportion to
+// their tickets.
+//
+// Passes are per-CPU virtual times. rq.pass is the pass of
+// the process a CPU dispatched last. A process that wakes
+// up behind it is moved up to it, so sleeping does not
+// build up credit, and a stolen process is rebased from
+// the victim's virtual time onto the thief's.
+
+// Is pass a before pass b? Allows for wraparound.
+static int
+passbefore(uint64 a, uint64 b)
+{
+  return (long)(a - b) < 0;
+}
+
+// Insert p into c's run queue, in pass order.
+// Caller must hold p->lock.
+static void
+runqput(struct cpu *c, struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&c->rq.lock);
+  if(passbefore(p->pass, c->rq.pass))
+    p->pass = c->rq.pass;
+  for(pp = &c->rq.head; *pp; pp = &(*pp)->rqnext)
+    if(passbefore(p->pass, (*pp)->pass))
+      break;
+  p->rqnext = *pp;
+  *pp = p;
+  c->rq.len++;
+  release(&c->rq.lock);
+}
+
+// Remove and return the process in c's run queue with
+// the smallest pass that may run on CPU to, or 0 if there
+// is none.
+static struct proc*
+runqget(struct cpu *c, struct cpu *to)
+{
+  struct proc **pp, *p;
+
+  acquire(&c->rq.lock);
+  for(pp = &c->rq.head; (p = *pp) != 0; pp = &p->rqnext)
+    if(canrun(p, c, to))
+      break;
+  if(p){
+    *pp = p->rqnext;
+    p->rqnext = 0;
+    c->rq.len--;
+    if(to == c)
+      c->rq.pass = p->pass;
+  }
+  release(&c->rq.lock);
+  return p;
+}
+
+// Is a process in c's run queue allowed to run on CPU to?
+static int
+runqhas(struct cpu *c, struct cpu *to)
+{
+  struct proc *p;
+
+  acquire(&c->rq.lock);
+  for(p = c->rq.head; p; p = p->rqnext)
+    if(canrun(p, c, to))
+      break;
+  release(&c->rq.lock);
+  return p != 0;
+}
+
+// Should a process queued on c run before p?
+// Unlocked, so only a hint.
+static int
+runqwaiting(struct cpu *c, struct proc *p)
+{
+  struct proc *q = c->rq.head;
+
+  return q != 0 && !passbefore(p->pass, q->pass);
+}
+
+// Is a process queued on c that should preempt p, the
+// process running there, without waiting for a tick?
+// Unlocked, so only a hint.
+static int
+runqpreempts(struct cpu *c, struct proc *p)
+{
+  struct proc *q = c->rq.head;
+
+  return q != 0 && passbefore(q->pass, p->pass);
+}
+
+// p has been taken from from's run queue to run on to.
+static void
+runqmove(struct proc *p, struct cpu *from, struct cpu *to)
+{
+  p->pass = p->pass - from->rq.pass + to->rq.pass;
+}
+
+// Charge the running process p for a timer tick.
+// Returns 1 if p should give up the CPU.
+// Caller must hold p->lock.
+static int
+tickcharge(struct proc *p)
+{
+  p->pass += p->stride;
+  return runqwaiting(mycpu(), p);
+}
+
+#else
+
+// Multi-level feedback queue scheduling. A process starts
+// at priority 0 and drops one level each time it uses up the
+// time slice for its level, so processes that sleep before
+// their slice ends (interactive ones) keep a high priority
+// and CPU-bound ones sink. Every BOOSTTICKS ticks everything
+// moves back to level 0, so low levels cannot starve.
+//
+// Boosts are applied lazily, by comparing the boost epoch a
+// process or run queue last saw with the current one.
+
+// time slice, in ticks, at each priority level.
+static int quantum[NPRIO] = { 1, 2, 4, 8 };
+
+static uint
+boostepoch(void)
+{
+  return ticks / BOOSTTICKS;
+}
+
+// Apply any priority boost p has missed.
+// Caller must hold p->lock.
+static void
+boostproc(struct proc *p)
+{
+  uint b = boostepoch();
+
+  if(p->boost != b){
+    p->boost = b;
+    p->priority = 0;
+    p->runticks = 0;
+  }
+}
+
+// Append p to c's run queue at p's priority.
+// Caller must hold p->lock.
+static void
+runqput(struct cpu *c, struct proc *p)
+{
+  int prio;
+
+  boostproc(p);
+  prio = p->priority;
+  acquire(&c->rq.lock);
+  p->rqnext = 0;
+  if(c->rq.tail[prio])
+    c->rq.tail[prio]->rqnext = p;
+  else
+    c->rq.head[prio] = p;
+  c->rq.tail[prio] = p;
+  c->rq.len++;
+  release(&c->rq.lock);
+}
+
+// Remove and return the highest-priority process in
+// c's run queue that may run on CPU to, or 0 if there
+// is none.
+static struct proc*
+runqget(struct cpu *c, struct cpu *to)
+{
+  struct proc *p = 0, *prev;
+  uint b = boostepoch();
+  int i;
+
+  acquire(&c->rq.lock);
+  if(c->rq.boost != b){
+    // a boost happened: splice every level onto level 0,
+    // keeping the order. each process resets its own
+    // priority when it next passes through boostproc().
+    c->rq.boost = b;
+    for(i = 1; i < NPRIO; i++){
+      if(c->rq.head[i] == 0)
+        continue;
+      if(c->rq.tail[0])
+        c->rq.tail[0]->rqnext = c->rq.head[i];
+      else
+        c->rq.head[0] = c->rq.head[i];
+      c->rq.tail[0] = c->rq.tail[i];
+      c->rq.head[i] = c->rq.tail[i] = 0;
+    }
+  }
+  for(i = 0; i < NPRIO; i++){
+    prev = 0;
+    for(p = c->rq.head[i]; p; prev = p, p = p->rqnext)
+      if(canrun(p, c, to))
+        break;
+    if(p){
+      if(prev)
+        prev->rqnext = p->rqnext;
+      else
+        c->rq.head[i] = p->rqnext;
+      if(c->rq.tail[i] == p)
+        c->rq.tail[i] = prev;
+      p->rqnext = 0;
+      c->rq.len--;
+      break;
+    }
+  }
+  release(&c->rq.lock);
+  return p;
+}
+
+// Is a process in c's run queue allowed to run on CPU to?
+// Looks only at the levels, without applying a boost.
+static int
+runqhas(struct cpu *c, struct cpu *to)
+{
+  struct proc *p = 0;
+
+  acquire(&c->rq.lock);
+  for(int i = 0; i < NPRIO && p == 0; i++)
+    for(p = c->rq.head[i]; p; p = p->rqnext)
+      if(canrun(p, c, to))
+        break;
+  release(&c->rq.lock);
+  return p != 0;
+}
+
+// Is a process queued on c that should preempt p, the
+// process running there, without waiting for a tick?
+// Only a strictly higher priority does.
+// Unlocked, so only a hint.
+static int
+runqpreempts(struct cpu *c, struct proc *p)
+{
+  for(int i = 0; i < p->priority; i++)
+    if(c->rq.head[i])
+      return 1;
+  return 0;
+}
+
+// p has been taken from from's run queue to run on to.
+static void
+runqmove(struct proc *p, struct cpu *from, struct cpu *to)
+{
+}
+
+// Charge the running process p for a timer tick, demoting
+// it if it has used up its time slice.
+// Returns 1 if p should give up the CPU: at the end of its
+// slice, which round-robins a level, or for a process of
+// higher priority.
+// Caller must hold p->lock.
+static int
+tickcharge(struct proc *p)
+{
+  boostproc(p);
+  if(++p->runticks >= quantum[p->priority]){
+    if(p->priority < NPRIO-1)
+      p->priority++;
+    p->runticks = 0;
+    return 1;
+  }
+  return runqpreempts(mycpu(), p);
+}
+
+#endif
+
+// Is tick a before tick b? Allows for wraparound.
+static int
+tickbefore(uint a, uint b)
+{
+  return (int)(a - b) < 0;
+}
+
+// Insert p into dlq, in deadline order.
+// Caller must hold p->lock.
+static void
+dlput(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&dlq.lock);
+  for(pp = &dlq.head; *pp; pp = &(*pp)->rqnext)
+    if(tickbefore(p->dlabs, (*pp)->dlabs))
+      break;
+  p->rqnext = *pp;
+  *pp = p;
+  dlq.len++;
+  release(&dlq.lock);
+}
+
+// Remove and return the process with the earliest
+// deadline that may run on c, or 0 if there is none.
+static struct proc*
+dlget(struct cpu *c)
+{
+  struct proc **pp, *p;
+
+  // unlocked peek, since dlq is usually empty.
+  if(dlq.head == 0)
+    return 0;
+  acquire(&dlq.lock);
+  for(pp = &dlq.head; (p = *pp) != 0; pp = &p->rqnext)
+    if(p->affinity & CPUBIT(c))
+      break;
+  if(p){
+    *pp = p->rqnext;
+    p->rqnext = 0;
+    dlq.len--;
+  }
+  release(&dlq.lock);
+  return p;
+}
+
+// Should p, running on c, give up the CPU now for a
+// queued process? A deadline process preempts any normal
+// one, or one with a later deadline.
+// Unlocked, so only a hint.
+static int
+preempts(struct cpu *c, struct proc *p)
+{
+  struct proc *q = dlq.head;
+
+  if(q != 0 && (p->dlperiod == 0 || tickbefore(q->dlabs, p->dlabs)))
+    return 1;
+  return p->dlperiod == 0 && runqpreempts(c, p);
+}
+
+// Change p's admitted utilization to u. Fails if that
+// would put the total over what the online CPUs can run.
+// Caller must hold p->lock.
+static int
+dlsetutil(struct proc *p, uint64 u)
+{
+  struct cpu *c;
+  uint64 cap = 0;
+
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    if(c->online)
+      cap += DLUNIT;
+  acquire(&dlq.lock);
+  if(u > p->dlutil && dlq.util - p->dlutil + u > cap){
+    release(&dlq.lock);
+    return -1;
+  }
+  dlq.util = dlq.util - p->dlutil + u;
+  p->dlutil = u;
+  release(&dlq.lock);
+  return 0;
+}
+
+// Wait for the start of the current deadline process's
+// next period, then give it a fresh budget and deadline.
+// A period that should already have started starts now.
+static void
+dlnextperiod(struct proc *p)
+{
+  uint r;
+
+  acquire(&p->lock);
+  r = p->dlnext;
+  // the wakeups below queue p by its next deadline.
+  p->dlabs = r + p->dldeadline;
+  release(&p->lock);
+
+  acquire(&tickslock);
+  while(tickbefore(ticks, r) && !killed(p))
+    sleep(&ticks, &tickslock);
+  if(tickbefore(r, ticks))
+    r = ticks;
+  release(&tickslock);
+
+  acquire(&p->lock);
+  p->dlabs = r + p->dldeadline;
+  p->dlnext = r + p->dlperiod;
+  p->dlbudget = p->dlruntime;
+  release(&p->lock);
+}
+
+// Take the first process allowed on c from some other
+// CPU's run queue, for a CPU whose own queue is empty.
+// Victims are tried round-robin starting after c, and
+// only one run queue lock is held at a time.
+static struct proc*
+runqsteal(struct cpu *c)
+{
+  struct cpu *v;
+  struct proc *p;
+  int i;
+
+  for(i = 1; i < NCPU; i++){
+    v = &cpus[(c - cpus + i) % NCPU];
+    // unlocked peek; runqget() rechecks under the lock.
+    if(!v->online || v->rq.len == 0)
+      continue;
+    if((p = runqget(v, c)) != 0){
+      runqmove(p, v, c);
+      c->nsteal++;
+      return p;
+    }
+  }
+  return 0;
+}
+
+// Choose a CPU in mask for a process to run on: the
+// online CPU with the shortest run queue, this one if
+// there is a tie. Before any CPU has entered scheduler(),
+// that is the boot CPU, or else the first CPU in mask.
+static int
+pickcpu(int mask)
+{
+  struct cpu *c, *best = 0;
+
+  push_off();
+  if(mask & CPUBIT(mycpu()))
+    best = mycpu();
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    if(c->online && (mask & CPUBIT(c)) &&
+       (best == 0 || c->rq.len < best->rq.len))
+      best = c;
+  pop_off();
+  if(best == 0)
+    for(best = cpus; (mask & CPUBIT(best)) == 0; best++)
+      ;
+  return best - cpus;
+}
+
+// p has been queued on c. If c is idle, wake it up.
+// If p should preempt what c is running, interrupt c,
+// which will call resched(). Otherwise wake some other
+// idle CPU in p's affinity mask, which can steal it.
+static void
+kick(struct cpu *c, struct proc *p)
+{
+  struct cpu *o;
+  struct proc *cur;
+
+  // pairs with the barrier in idle(): either this sees
+  // the idle flag, or idle() sees the queued work.
+  __sync_synchronize();
+  if(c->idle){
+    ipi(c - cpus);
+    return;
+  }
+  // an unlocked peek at c's process. procs are never
+  // freed, so at worst this reads a stale priority and
+  // sends a needless IPI, or leaves it to the next tick.
+  cur = c->proc;
+  if(cur != 0 && preempts(c, cur)){
+    ipi(c - cpus);
+    return;
+  }
+  for(o = cpus; o < &cpus[NCPU]; o++){
+    if(o->idle && (p->affinity & CPUBIT(o))){
+      ipi(o - cpus);
+      return;
+    }
+  }
+}
+
+// Deadline process p has been queued. Find a CPU in its
+// affinity mask to run it: an idle one, else the one
+// running the process it should preempt most, a normal
+// process or else the latest deadline.
+static void
+dlkick(struct proc *p)
+{
+  struct cpu *c, *best = 0;
+  struct proc *cur, *victim = 0;
+
+  // pairs with the barrier in idle().
+  __sync_synchronize();
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(!c->online || (p->affinity & CPUBIT(c)) == 0)
+      continue;
+    if(c->idle){
+      ipi(c - cpus);
+      return;
+    }
+    // unlocked peek, as in kick().
+    if((cur = c->proc) == 0)
+      return;  // c is in scheduler() and will see dlq.
+    if(victim == 0 ||
+       (victim->dlperiod != 0 &&
+        (cur->dlperiod == 0 || tickbefore(victim->dlabs, cur->dlabs)))){
+      best = c;
+      victim = cur;
+    }
+  }
+  if(best && preempts(best, victim))
+    ipi(best - cpus);
+}
+
+// Mark p RUNNABLE and queue it: on dlq if it is in the
+// deadline class, else on the CPU it last ran on, whose
+// caches are most likely to still hold its state, if
+// its affinity mask still allows that CPU.
+// Caller must hold p->lock.
+static void
+makerunnable(struct proc *p)
+{
+  int here;
+
+  tracerec(TR_WAKEUP, p->pid, p->state);
+  p->state = RUNNABLE;
+  p->queuedat = r_time();
+  here = p == myproc() && (p->affinity & CPUBIT(mycpu()));
+  if(p->dlperiod){
+    dlput(p);
+    if(!here)
+      dlkick(p);
+    return;
+  }
+  if((p->affinity & (1 << p->cpu)) == 0)
+    p->cpu = pickcpu(p->affinity);
+  runqput(&cpus[p->cpu], p);
+  // a yielding process is about to be picked up
+  // again by this CPU; anything else may need a
+  // sleeping CPU.
+  if(!here)
+    kick(&cpus[p->cpu], p);
+}
+
+// Pages have been unmapped from pagetable, which threads
+// may be using on other CPUs. Interrupt those CPUs and
+// wait for each to enter the kernel, since uservec
+// flushes the TLB on the way in. A CPU may be back in
+// user space with the same page table by the time it is
+// looked at again, so wait for its count of entries to
+// move rather than for it to leave pagetable.
+static void
+shootdown(pagetable_t pagetable)
+{
+  struct cpu *c;
+  uint64 n;
+
+  push_off();
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(c == mycpu())
+      continue;
+    n = c->ntrap;
+    __sync_synchronize();
+    if(c->upagetable != pagetable)
+      continue;
+    ipi(c - cpus);
+    while(c->ntrap == n)
+      __sync_synchronize();
+  }
+  pop_off();
+}
+
+// The region of l containing va, or 0.
+// l->memlock must be held.
+static struct vma*
+findvma(struct proc *l, uint64 va)
+{
+  struct vma *v;
+
+  for(v = l->vma; v < &l->vma[NVMA]; v++)
+    if(v->flags && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Allocate the page array of a MAP_SHARED region of
+// npages pages, with one reference.
+static struct shmem *
+shmalloc(uint64 npages)
+{
+  struct shmem *shm;
+  int order;
+
+  for(order = 0; order < NORDER; order++)
+    if(sizeof(*shm) + npages * sizeof(uint64) <= (PGSIZE << order))
+      break;
+  if(order == NORDER || (shm = kallocpages(order)) == 0)
+    return 0;
+  memset(shm, 0, PGSIZE << order);
+  initlock(&shm->lock, "shmem");
+  shm->ref = 1;
+  shm->order = order;
+  shm->npages = npages;
+  return shm;
+}
+
+static void
+shmdup(struct shmem *shm)
+{
+  acquire(&shm->lock);
+  shm->ref++;
+  release(&shm->lock);
+}
+
+// Drop a region's reference to shm, freeing its
+// pages with the last.
+static void
+shmput(struct shmem *shm)
+{
+  uint64 i;
+  int ref;
+
+  acquire(&shm->lock);
+  ref = --shm->ref;
+  release(&shm->lock);
+  if(ref > 0)
+    return;
+  for(i = 0; i < shm->npages; i++)
+    if(shm->pages[i])
+      kfree((void*)shm->pages[i]);
+  kfreepages(shm, shm->order);
+}
+
+// The page of shm at index i with a reference taken for
+// the caller, or 0 if no region has filled it. If mem is
+// not 0, makes it the page unless another got there first.
+static char *
+shmpage(struct shmem *shm, uint64 i, char *mem)
+{
+  char *pa;
+
+  acquire(&shm->lock);
+  if(shm->pages[i] == 0 && mem)
+    shm->pages[i] = (uint64)mem;
+  if((pa = (char*)shm->pages[i]) != 0)
+    kdup(pa);
+  release(&shm->lock);
+  return pa;
+}
+
+// Map the page at va of l's region v, read in with
+// l->memlock released, or the page another region
+// sharing v->shm already has. v->busy keeps munmap()
+// from changing v meanwhile; exec() and exit() first
+// wait for l's other threads to exit. Called and
+// returns with l->memlock held.
+static int
+vmfill(struct proc *l, struct vma *v, uint64 va, int write)
+{
+  pte_t *pte;
+  char *mem = 0, *pa;
+  uint64 i = 0;
+  int perm, r = -1;
+
+  if(v->shm){
+    i = v->shmpg + (va - v->start) / PGSIZE;
+    if((mem = shmpage(v->shm, i, 0)) != 0)
+      r = 0;
+  }
+  if(mem == 0){
+    // the caller holds a spinlock besides memlock, such as
+    // a pipe's, while copying to or from user memory;
+    // reading the file would sleep with it held. It
+    // should have used prefault().
+    if(v->ip && mycpu()->noff > 1)
+      return -1;
+
+    v->busy++;
+    release(&l->memlock);
+    if((mem = kalloc()) != 0)
+      r = vmaload(v, va, mem);
+    acquire(&l->memlock);
+    if(--v->busy == 0)
+      wakeup(v);
+    if(r == 0 && v->shm){
+      // another process sharing the region may have
+      // filled the page meanwhile.
+      pa = shmpage(v->shm, i, mem);
+      if(pa != mem)
+        kfree(mem);
+      mem = pa;
+    }
+  }
+  if(r < 0 || va >= v->end ||
+     ((pte = walk(l->pagetable, va, 0)) != 0 && (*pte & PTE_V))){
+    // another thread mapped the page, or shrank memory,
+    // while the file was read; retry the access.
+    if(mem)
+      kfree(mem);
+    return r;
+  }
+  perm = v->perm | PTE_R | PTE_U;
+  if(v->flags & MAP_SHARED){
+    perm |= PTE_SHARED;
+    // keep a file's page read-only until it is written,
+    // so munmap() knows which pages to write back.
+    if(v->ip && (perm & PTE_W))
+      perm = write ? perm | PTE_D : perm & ~PTE_W;
+  }
+  if(mappages(l->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// The current process faulted on user address va in
+// pagetable, from user space or in copyin() or copyout().
+// If va is in its memory but was never touched, map the
+// page there: filled from its region if va is in one (see
+// struct vma), else zeroed. If write, mark a MAP_SHARED
+// file's page dirty, or give the process its own copy of
+// a copy-on-write page.
+// Returns 0 if the access can be retried, -1 if it is
+// bad or memory is short.
 int
-allocpid()
+vmfault(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc(), *l = p->leader;
+  struct vma *v = 0;
+  pte_t *pte;
+  int r = -1;
+
+  if(pagetable != p->pagetable)
+    return -1;
+  va = PGROUNDDOWN(va);
+  acquire(&l->memlock);
+  v = findvma(l, va);
+  if(walkaddr(pagetable, va) == 0){
+    // outside regions, only the heap is filled on demand;
+    // the rest is the image's gaps and guard page, and the
+    // holes munmap() leaves.
+    if(v)
+      r = vmfill(l, v, va, write);
+    else if(va >= l->heapbase && va < p->sz)
+      r = uvmdemand(pagetable, va);
+  } else if(write && v && (v->flags & MAP_SHARED)){
+    if((v->perm & PTE_W) && (pte = walk(pagetable, va, 0)) != 0){
+      *pte |= PTE_W | PTE_D;
+      r = 0;
+    }
+  } else if(write)
+    r = uvmcow(pagetable, va);
+  release(&l->memlock);
+  // other threads may still see the old page.
+  if(r > 0)
+    shootdown(pagetable);
+  return r < 0 ? -1 : 0;
+}
+
+// Find the page for a kernel copy to (if write) or from
+// user address va in pagetable, and take a reference to
+// it, so that another thread shrinking or unmapping the
+// memory meanwhile can't free it under the copy. The
+// copier kfree()s it when done. Returns its physical
+// address, or 0 if va is not mapped for the access.
+uint64
+vmpin(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc(), *l = p->leader;
+  int shared = pagetable == p->pagetable;
+  pte_t *pte;
+  uint64 pa = 0;
+
+  // exec() copies into a page table no thread uses yet.
+  if(shared)
+    acquire(&l->memlock);
+  if(va < MAXVA && (pte = walk(pagetable, va, 0)) != 0 &&
+     (*pte & PTE_V) && (*pte & PTE_U) && (!write || (*pte & PTE_W))){
+    pa = PTE2PA(*pte);
+    kdup((void*)pa);
+  }
+  if(shared)
+    release(&l->memlock);
+  return pa;
+}
+
+// Set the memory size of l and the threads it leads.
+// l->memlock must be held.
+static void
+setsz(struct proc *l, uint64 sz)
+{
+  struct proc *t;
+
+  l->sz = sz;
+  for(t = l->tnext; t; t = t->tnext)
+    t->sz = sz;
+}
+
+// Narrow region v to [start, end).
+static void
+vmatrim(struct vma *v, uint64 start, uint64 end)
+{
+  uint64 d = start - v->start;
+
+  v->off += d;
+  v->shmpg += d / PGSIZE;
+  v->filesz = v->filesz > d ? v->filesz - d : 0;
+  if(v->filesz > end - start)
+    v->filesz = end - start;
+  v->start = start;
+  v->end = end;
+}
+
+// The start of the lowest mmap() region, or MMAPTOP: how
+// far sbrk() can grow l's memory. l->memlock must be held.
+static uint64
+mmapbase(struct proc *l)
+{
+  struct vma *v;
+  uint64 base = MMAPTOP;
+
+  // exec()'s regions lie below l->sz.
+  for(v = l->vma; v < &l->vma[NVMA]; v++)
+    if(v->flags && v->start >= l->sz && v->start < base)
+      base = v->start;
+  return base;
+}
+
+// The highest address below MMAPTOP and above l's heap
+// where len bytes are free of regions, or 0 if there is
+// none. Reuses the holes munmap() leaves. l->memlock must
+// be held.
+static uint64
+mmapfind(struct proc *l, uint64 len)
+{
+  struct vma *v;
+  uint64 hi, lo, best = 0;
+  int i;
+
+  // the space must end at MMAPTOP or where a region starts.
+  for(i = -1; i < NVMA; i++){
+    if(i >= 0 && l->vma[i].flags == 0)
+      continue;
+    hi = i < 0 ? MMAPTOP : l->vma[i].start;
+    if(hi < len || (lo = hi - len) < PGROUNDUP(l->sz) || lo <= best)
+      continue;
+    for(v = l->vma; v < &l->vma[NVMA]; v++)
+      if(v->flags && v->start < hi && v->end > lo)
+        break;
+    if(v == &l->vma[NVMA])
+      best = lo;
+  }
+  return best;
+}
+
+// Add the region *nv describes to the caller's memory, in
+// the highest free space below MMAPTOP. Only the length
+// of nv's start and end counts. The region takes over nv's
+// file reference. Returns the region's address, or -1.
+uint64
+mmap(struct vma *nv)
+{
+  struct proc *p = myproc(), *l = p->leader;
+  struct vma *v;
+  struct shmem *shm = 0;
+  uint64 start;
+
+  if((nv->flags & MAP_SHARED) &&
+     (shm = shmalloc((nv->end - nv->start) / PGSIZE)) == 0)
+    return -1;
+
+  acquire(&l->memlock);
+  for(v = l->vma; v < &l->vma[NVMA]; v++)
+    if(v->flags == 0)
+      break;
+  if(v == &l->vma[NVMA] || (start = mmapfind(l, nv->end - nv->start)) == 0){
+    release(&l->memlock);
+    if(shm)
+      shmput(shm);
+    return -1;
+  }
+  *v = *nv;
+  v->start = start;
+  v->end = start + (nv->end - nv->start);
+  v->busy = 0;
+  v->shm = shm;
+  v->shmpg = 0;
+  release(&l->memlock);
+  return start;
+}
+
+// Remove the caller's regions in [addr, addr+len), first
+// writing the dirty pages of MAP_SHARED files back. Part
+// of a region can go, splitting it if need be. Memory in
+// the range that is in no region is left alone.
+// Returns 0, or -1 if the range is bad or a split finds
+// no free region.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc(), *l = p->leader;
+  struct inode *put[NVMA], *ip;
+  struct vma *v, *nv;
+  uint64 end, a, next, s, e, pa, d, off, start;
+  int i, n, nput = 0;
+  pte_t *pte;
+
+  if(addr % PGSIZE != 0 || addr >= MAXVA || len > MAXVA - addr)
+    return -1;
+  end = PGROUNDUP(addr + len);
+
+  acquire(&l->memlock);
+ again:
+  nv = 0;
+  for(v = l->vma; v < &l->vma[NVMA]; v++){
+    if(v->flags == 0){
+      nv = v;
+      continue;
+    }
+    if(v->end <= addr || v->start >= end)
+      continue;
+    if(v->busy){
+      sleep(v, &l->memlock);
+      goto again;
+    }
+  }
+  for(v = l->vma; v < &l->vma[NVMA]; v++){
+    if(v->flags == 0 || v->start >= addr || v->end <= end)
+      continue;
+    if(nv == 0){
+      release(&l->memlock);
+      return -1;
+    }
+  }
+
+  // write back dirty pages, cleaning each first so that a
+  // store by another thread dirties it again.
+  for(v = l->vma; v < &l->vma[NVMA]; v++){
+    if(!(v->flags & MAP_SHARED) || v->ip == 0)
+      continue;
+    s = v->start > addr ? v->start : addr;
+    e = v->end < end ? v->end : end;
+    for(a = s; a < e; a = next){
+      next = a + PGSIZE;
+      if((pte = walk(l->pagetable, a, 0)) == 0){
+        next = walkskip(l->pagetable, a);
+        continue;
+      }
+      if((*pte & PTE_V) == 0 || (*pte & PTE_D) == 0)
+        continue;
+      *pte &= ~(PTE_W | PTE_D);
+      if(l->tnext)
+        shootdown(l->pagetable);
+      pa = PTE2PA(*pte);
+      kdup((void*)pa);
+      ip = idup(v->ip);
+      start = v->start;
+      d = a - v->start;
+      off = v->off + d;
+      n = 0;
+      if(d < v->filesz)
+        n = v->filesz - d < PGSIZE ? v->filesz - d : PGSIZE;
+      release(&l->memlock);
+      if(n > 0)
+        vmawrite(ip, (char*)pa, off, n);
+      kfree((void*)pa);
+      begin_op();
+      iput(ip);
+      end_op();
+      acquire(&l->memlock);
+      // start over if another thread changed the regions.
+      if(v->ip != ip || v->start != start || a >= v->end)
+        goto again;
+    }
+  }
+
+  if(l->tnext){
+    // other threads may be using the pages: revoke user
+    // access and flush their TLBs before they are freed.
+    for(v = l->vma; v < &l->vma[NVMA]; v++){
+      if(v->flags == 0 || v->end <= addr || v->start >= end)
+        continue;
+      s = v->start > addr ? v->start : addr;
+      e = v->end < end ? v->end : end;
+      uvmrevoke(l->pagetable, s, e);
+    }
+    shootdown(l->pagetable);
+  }
+
+  for(v = l->vma; v < &l->vma[NVMA]; v++){
+    if(v->flags == 0 || v->end <= addr || v->start >= end)
+      continue;
+    s = v->start > addr ? v->start : addr;
+    e = v->end < end ? v->end : end;
+    uvmunmap(l->pagetable, s, (e - s) / PGSIZE, 1);
+    if(s == v->start && e == v->end){
+      if(v->ip)
+        put[nput++] = v->ip;
+      if(v->shm)
+        shmput(v->shm);
+      memset(v, 0, sizeof(*v));
+    } else if(s == v->start){
+      vmatrim(v, e, v->end);
+    } else if(e == v->end){
+      vmatrim(v, v->start, s);
+    } else {
+      *nv = *v;
+      if(nv->ip)
+        idup(nv->ip);
+      if(nv->shm)
+        shmdup(nv->shm);
+      vmatrim(nv, e, v->end);
+      vmatrim(v, v->start, s);
+    }
+  }
+  release(&l->memlock);
+
+  if(nput > 0){
+    begin_op();
+    for(i = 0; i < nput; i++)
+      iput(put[i]);
+    end_op();
+  }
+  return 0;
+}
+
+// Is there any queued work CPU to could run? Processes
+// whose affinity keeps them off to don't count, or to
+// would spin in scheduler() instead of waiting.
+static int
+haswork(struct cpu *to)
+{
+  struct cpu *c;
+  struct proc *p = 0;
+
+  // unlocked peeks, since the queues are usually empty.
+  if(dlq.len > 0){
+    acquire(&dlq.lock);
+    for(p = dlq.head; p; p = p->rqnext)
+      if(p->affinity & CPUBIT(to))
+        break;
+    release(&dlq.lock);
+  }
+  if(p)
+    return 1;
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    if(c->rq.len > 0 && runqhas(c, to))
+      return 1;
+  return 0;
+}
+
+// Called by scheduler() when there is nothing to run.
+// Wait in wfi for an interrupt: from a device, the timer
+// on CPU 0 (which keeps ticks), or an IPI from kick().
+// Other CPUs stop their timer while idle, since there is
+// nothing to preempt. Counts the cycles spent waiting.
+static void
+idle(struct cpu *c)
+{
+  uint64 t0;
+
+  intr_off();
+  c->idle = 1;
+  __sync_synchronize();
+  if(!haswork(c)){
+    if(c != &cpus[0])
+      settimer(-1);
+    t0 = r_time();
+    wfi();
+    c->idlecycles += r_time() - t0;
+    if(c != &cpus[0])
+      settimer(r_time() + TICKCYCLES);
+  }
+  c->idle = 0;
+  // scheduler() turns interrupts back on, which takes
+  // whatever interrupt woke us.
+}
+
+// Look up pid in pidhash.
+// Caller must hold pid_lock.
+static struct proc*
+pidlookup(int pid)
+{
+  struct proc *p;
+
+  for(p = pidhash[PIDHASH(pid)]; p; p = p->pidnext)
+    if(p->pid == pid)
+      return p;
+  return 0;
+}
+
+// Give p an unused pid and enter it in pidhash.
+// Caller must hold p->lock.
+static void
+allocpid(struct proc *p)
 {
   int pid;
   
   acquire(&pid_lock);
-  pid = nextpid;
-  nextpid = nextpid + 1;
+  do {
+    pid = nextpid;
+    nextpid = nextpid + 1;
+    if(nextpid >= MAXPID)
+      nextpid = 2;  // never reuse init's pid
+  } while(pidlookup(pid));
+  p->pid = pid;
+  p->pidnext = pidhash[PIDHASH(pid)];
+  pidhash[PIDHASH(pid)] = p;
   release(&pid_lock);
+}
 
-  return pid;
+// Remove p from pidhash and clear its pid.
+// Caller must hold p->lock.
+static void
+freepid(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&pid_lock);
+  for(pp = &pidhash[PIDHASH(p->pid)]; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  p->pidnext = 0;
+  p->pid = 0;
+  release(&pid_lock);
 }
 
-// Look in the process table for an UNUSED proc.
+// Take an UNUSED proc off the free list, first carving
+// a new page into procs if the list is empty.
+// Returns 0 if NPROC procs are in use or memory is short.
+static struct proc*
+procget(void)
+{
+  struct proc *p, *end;
+  char *page;
+
+  acquire(&ptable.lock);
+  if(ptable.free == 0 && ptable.n < NPROC && (page = kalloc()) != 0){
+    memset(page, 0, PGSIZE);
+    end = (struct proc*)(page + PGSIZE);
+    for(p = (struct proc*)page; p + 1 <= end && ptable.n < NPROC; p++){
+      initlock(&p->lock, "proc");
+      initlock(&p->memlock, "memlock");
+      initlock(&p->filelock, "filelock");
+      p->state = UNUSED;
+      // each proc keeps its own kernel stack address,
+      // but the stack page itself comes and goes.
+      p->kstack = KSTACK(ptable.n++);
+      p->allnext = ptable.all;
+      ptable.all = p;
+      p->nextfree = ptable.free;
+      ptable.free = p;
+    }
+  }
+  if((p = ptable.free) != 0)
+    ptable.free = p->nextfree;
+  release(&ptable.lock);
+  return p;
+}
+
+// Return p to the free list.
+// Caller must hold p->lock, and p must be UNUSED.
+static void
+procput(struct proc *p)
+{
+  acquire(&ptable.lock);
+  p->nextfree = ptable.free;
+  ptable.free = p;
+  release(&ptable.lock);
+}
+
+// Allocate an UNUSED proc and a kernel stack for it.
 // If found, initialize state required to run in the kernel,
-// and return with p->lock held.
+// and return with p->lock held. Unless thread is set, also
+// give it a user page table of its own.
 // If there are no free procs, or a memory allocation fails, return 0.
 static struct proc*
-allocproc(void)
+allocproc(int thread)
 {
   struct proc *p;
+  char *kstack;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
+  if((p = procget()) == 0)
+    return 0;
+  acquire(&p->lock);
+
+  // Allocate and map a kernel stack. The page below it
+  // in the kernel page table stays unmapped, as a guard.
+  if((kstack = kalloc()) == 0){
+    procput(p);
+    release(&p->lock);
+    return 0;
+  }
+  if(kvmmapstack(p->kstack, (uint64)kstack) < 0){
+    kfree(kstack);
+    procput(p);
+    release(&p->lock);
+    return 0;
   }
-  return 0;
 
-found:
-  p->pid = allocpid();
+  allocpid(p);
   p->state = USED;
+  p->priority = 0;
+  p->runticks = 0;
+  p->boost = ticks / BOOSTTICKS;
+  p->tickets = DEFTICKETS;
+  p->stride = STRIDE1 / DEFTICKETS;
+  p->pass = 0;
+  p->dlperiod = 0;
+  p->dlutil = 0;
+  p->affinity = ALLCPUS;
+  p->leader = p;
+  p->tnext = 0;
+  p->tfva = TRAPFRAME;
+  memset(&p->ru, 0, sizeof(p->ru));
+  memset(&p->cru, 0, sizeof(p->cru));
+  memset(&p->tru, 0, sizeof(p->tru));
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -132,9 +1365,9 @@ found:
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
+  // An empty user page table. A thread's creator
+  // shares its own with it instead.
+  if(!thread && (p->pagetable = proc_pagetable(p)) == 0){
     freeproc(p);
     release(&p->lock);
     return 0;
@@ -150,8 +1383,9 @@ found:
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
-// p->lock must be held.
+// including user pages and the kernel stack, and put
+// it back on the free list.
+// p->lock must be held, and p must not be running.
 static void
 freeproc(struct proc *p)
 {
@@ -161,14 +1395,19 @@ freeproc(struct proc *p)
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
+  kvmunmapstack(p->kstack);
+  if(p->pid)
+    freepid(p);
   p->sz = 0;
-  p->pid = 0;
   p->parent = 0;
+  p->child = 0;
+  p->sibling = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
   p->state = UNUSED;
+  procput(p);
 }
 
 // Create a user page table for a given process, with no user memory,
@@ -234,13 +1473,14 @@ userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
   
   // allocate one user page and copy initcode's instructions
   // and data into it.
   uvmfirst(p->pagetable, initcode, sizeof(initcode));
   p->sz = PGSIZE;
+  p->heapbase = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
@@ -249,7 +1489,8 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  p->cpu = pickcpu(p->affinity);
+  makerunnable(p);
 
   release(&p->lock);
 }
@@ -259,18 +1500,39 @@ userinit(void)
 int
 growproc(int n)
 {
-  uint64 sz;
-  struct proc *p = myproc();
+  uint64 sz, a;
+  struct proc *p = myproc(), *l = p->leader;
+
+  if(n < 0 && -n <= p->sz){
+    // regions in the memory given up go with it, after
+    // their dirty pages are written back.
+    a = PGROUNDUP(p->sz + n);
+    munmap(a, PGROUNDUP(p->sz) - a);
+  }
 
+  acquire(&l->memlock);
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    // pages are allocated when first touched; see vmfault().
+    if(sz + n > mmapbase(l)){
+      release(&l->memlock);
       return -1;
     }
+    sz += n;
   } else if(n < 0){
+    if(l->tnext){
+      // other threads may be using the pages: revoke
+      // user access and flush their TLBs before the
+      // pages are freed.
+      uvmrevoke(p->pagetable, PGROUNDUP(sz + n), PGROUNDUP(sz));
+      shootdown(p->pagetable);
+    }
     sz = uvmdealloc(p->pagetable, sz, sz + n);
+    if(sz < l->heapbase)
+      l->heapbase = sz;
   }
-  p->sz = sz;
+  setsz(l, sz);
+  release(&l->memlock);
   return 0;
 }
 
@@ -283,60 +1545,210 @@ fork(void)
   struct proc *np;
   struct proc *p = myproc();
 
-  // Allocate process.
-  if((np = allocproc()) == 0){
+  // Allocate process.
+  if((np = allocproc(0)) == 0){
+    return -1;
+  }
+
+  // Copy user memory from parent to child, keeping
+  // other threads from changing it meanwhile.
+  acquire(&p->leader->memlock);
+  if(uvmcopy(p->pagetable, np->pagetable, MMAPTOP) < 0){
+    release(&p->leader->memlock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->sz = p->sz;
+  np->heapbase = p->leader->heapbase;
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = p->leader->vma[i];
+    np->vma[i].busy = 0;
+    if(np->vma[i].ip)
+      idup(np->vma[i].ip);
+    if(np->vma[i].shm)
+      shmdup(np->vma[i].shm);
+  }
+  release(&p->leader->memlock);
+  // other threads may still have writable mappings
+  // of what are now copy-on-write pages.
+  shootdown(p->pagetable);
+
+  // copy saved user registers.
+  *(np->trapframe) = *(p->trapframe);
+
+  // Cause fork to return 0 in the child.
+  np->trapframe->a0 = 0;
+
+  // increment reference counts on open file descriptors.
+  acquire(&p->leader->filelock);
+  for(i = 0; i < NOFILE; i++)
+    if(p->leader->ofile[i])
+      np->ofile[i] = filedup(p->leader->ofile[i]);
+  np->cwd = idup(p->leader->cwd);
+  release(&p->leader->filelock);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  np->tickets = p->tickets;
+  np->stride = p->stride;
+  np->affinity = p->affinity;
+
+  pid = np->pid;
+  tracerec(TR_FORK, p->pid, pid);
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  np->parent = p;
+  np->sibling = p->child;
+  p->child = np;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->cpu = pickcpu(np->affinity);
+  makerunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a thread: a process that shares the caller's
+// page table, and runs fn(arg) in user space on the stack
+// whose top is stack. It also shares the caller's open
+// files and cwd: a descriptor opened or closed, or a
+// chdir(), by one thread is seen by all of its group.
+// The thread is a child of the first process of the
+// group, for join().
+// Returns the thread's pid, or -1.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int i, pid;
+  uint64 used = 1;
+  struct proc *np, *t;
+  struct proc *p = myproc(), *l = p->leader;
+
+  if((np = allocproc(1)) == 0)
     return -1;
-  }
 
-  // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // map the thread's trapframe in a free slot.
+  acquire(&l->memlock);
+  for(t = l->tnext; t; t = t->tnext)
+    used |= 1L << ((TRAPFRAME - t->tfva) / PGSIZE);
+  for(i = 1; i < NTHREAD && (used & (1L << i)); i++)
+    ;
+  if(i == NTHREAD || mappages(l->pagetable, THREADFRAME(i), PGSIZE,
+                              (uint64)np->trapframe, PTE_R | PTE_W) < 0){
+    release(&l->memlock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
-  np->sz = p->sz;
+  np->leader = l;
+  np->tfva = THREADFRAME(i);
+  np->pagetable = l->pagetable;
+  np->sz = l->sz;
+  np->tnext = l->tnext;
+  l->tnext = np;
+  release(&l->memlock);
 
-  // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
-
-  // Cause fork to return 0 in the child.
-  np->trapframe->a0 = 0;
-
-  // increment reference counts on open file descriptors.
-  for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  np->trapframe->ra = 0;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
+  np->tickets = p->tickets;
+  np->stride = p->stride;
+  np->affinity = p->affinity;
+
   pid = np->pid;
+  tracerec(TR_FORK, p->pid, pid);
 
   release(&np->lock);
 
   acquire(&wait_lock);
-  np->parent = p;
+  np->parent = l;
+  np->sibling = l->child;
+  l->child = np;
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  np->cpu = pickcpu(np->affinity);
+  makerunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
+// Kill the threads sharing p's page table, wait for them
+// to exit, and free them. p must lead the group.
+void
+killthreads(struct proc *p)
+{
+  struct proc *t, **tp;
+  int n;
+
+  acquire(&wait_lock);
+  for(;;){
+    n = 0;
+    for(tp = &p->child; (t = *tp) != 0; ){
+      if(t->leader != p){
+        tp = &t->sibling;
+        continue;
+      }
+      acquire(&t->lock);
+      if(t->state == ZOMBIE){
+        *tp = t->sibling;
+        freeproc(t);
+        release(&t->lock);
+        continue;
+      }
+      t->killed = 1;
+      if(t->state == SLEEPING)
+        makerunnable(t);
+      release(&t->lock);
+      n++;
+      tp = &t->sibling;
+    }
+    if(n == 0)
+      break;
+    // exiting threads wake their parent, p.
+    sleep(p, &wait_lock);
+  }
+  release(&wait_lock);
+}
+
+// Add the CPU usage in *b to *a.
+static void
+cputimeadd(struct cputime *a, struct cputime *b)
+{
+  a->utime += b->utime;
+  a->stime += b->stime;
+  a->wtime += b->wtime;
+  a->nvcsw += b->nvcsw;
+  a->nivcsw += b->nivcsw;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
+  struct proc *pp, *last = 0;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  for(pp = p->child; pp; pp = pp->sibling){
+    pp->parent = initproc;
+    last = pp;
+  }
+  if(last){
+    last->sibling = initproc->child;
+    initproc->child = p->child;
+    p->child = 0;
+    wakeup(initproc);
   }
 }
 
@@ -351,32 +1763,63 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
+  if(p->leader == p){
+    // take any threads down with the process, then
+    // write back its MAP_SHARED files.
+    killthreads(p);
+    munmap(0, MAXVA);
+  } else {
+    // a thread: free its trapframe slot, and leave
+    // the page table to the rest of the group.
+    struct proc *l = p->leader, **tp;
+
+    acquire(&l->memlock);
+    uvmunmap(p->pagetable, p->tfva, 1, 0);
+    for(tp = &l->tnext; *tp != p; tp = &(*tp)->tnext)
+      ;
+    *tp = p->tnext;
+    cputimeadd(&l->tru, &p->ru);
+    release(&l->memlock);
+    p->pagetable = 0;
+    p->sz = 0;
   }
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
+  // Close all open files. A thread has none of its
+  // own: they are its leader's, and outlive it.
+  if(p->leader == p){
+    for(int fd = 0; fd < NOFILE; fd++){
+      if(p->ofile[fd]){
+        struct file *f = p->ofile[fd];
+        fileclose(f);
+        p->ofile[fd] = 0;
+      }
+    }
+
+    begin_op();
+    iput(p->cwd);
+    end_op();
+    p->cwd = 0;
+  }
 
   acquire(&wait_lock);
 
   // Give any children to init.
   reparent(p);
 
+  // a thread's waited-for children count for its group.
+  if(p->leader != p)
+    cputimeadd(&p->leader->cru, &p->cru);
+
   // Parent might be sleeping in wait().
   wakeup(p->parent);
   
   acquire(&p->lock);
 
+  dlsetutil(p, 0);
+  p->dlperiod = 0;
   p->xstate = status;
   p->state = ZOMBIE;
+  tracerec(TR_EXIT, p->pid, status);
 
   release(&wait_lock);
 
@@ -390,37 +1833,45 @@ exit(int status)
 int
 wait(uint64 addr)
 {
-  struct proc *pp;
+  struct proc *pp, **ppp;
   int havekids, pid;
   struct proc *p = myproc();
 
+  // the status is copied out with wait_lock held.
+  if(addr != 0)
+    prefault(p->pagetable, addr, sizeof(int), 1);
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
+    // Threads are left for join().
     havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
+    for(ppp = &p->child; (pp = *ppp) != 0; ppp = &pp->sibling){
+      if(pp->leader != pp)
+        continue;
+      havekids = 1;
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      if(pp->state == ZOMBIE){
+        // Found one.
+        pid = pp->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                                sizeof(pp->xstate)) < 0) {
           release(&pp->lock);
           release(&wait_lock);
-          return pid;
+          return -1;
         }
+        *ppp = pp->sibling;
+        cputimeadd(&p->cru, &pp->ru);
+        cputimeadd(&p->cru, &pp->tru);
+        cputimeadd(&p->cru, &pp->cru);
+        freeproc(pp);
         release(&pp->lock);
+        release(&wait_lock);
+        return pid;
       }
+      release(&pp->lock);
     }
 
     // No point waiting if we don't have any children.
@@ -434,49 +1885,48 @@ wait(uint64 addr)
   }
 }
 
-// Per-CPU process scheduler.
-// Each CPU calls scheduler() after setting itself up.
-// Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
-//  - swtch to start running that process.
-//  - eventually that process transfers control
-//    via swtch back to the scheduler.
-// void
-// scheduler(void)
-// {
-//   struct proc *p;
-//   struct cpu *c = mycpu();
-  
-//   c->proc = 0;
-//   for(;;){
-//     // Avoid deadlock by ensuring that devices can interrupt.
-//     intr_on();
-
-//     for(p = proc; p < &proc[NPROC]; p++) {
-//       acquire(&p->lock);
-//       if(p->state == RUNNABLE) {
-//         // Switch to chosen process.  It is the process's job
-//         // to release its lock and then reacquire it
-//         // before jumping back to us.
-//         p->state = RUNNING;
-//         c->proc = p;
-//         swtch(&c->context, &p->context);
-
-//         // Process is done running for now.
-//         // It should have changed its p->state before coming back.
-//         c->proc = 0;
-//       }
-//       release(&p->lock);
-//     }
-//   }
-// }
+// Wait for thread tid, which shares the caller's page
+// table, to exit, and free it.
+// Return tid, or -1 if there is no such thread.
+int
+join(int tid)
+{
+  struct proc *t, **tp;
+  struct proc *p = myproc(), *l = p->leader;
+
+  acquire(&wait_lock);
 
+  for(;;){
+    // threads are children of the group leader.
+    for(tp = &l->child; (t = *tp) != 0; tp = &t->sibling)
+      if(t->pid == tid && t->leader == l && t != l)
+        break;
+    if(t == 0 || t == p || killed(p)){
+      release(&wait_lock);
+      return -1;
+    }
+    acquire(&t->lock);
+    if(t->state == ZOMBIE){
+      *tp = t->sibling;
+      freeproc(t);
+      release(&t->lock);
+      release(&wait_lock);
+      return tid;
+    }
+    release(&t->lock);
 
+    // exiting threads wake their parent, l.
+    sleep(l, &wait_lock);
+  }
+}
 
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - take the earliest-deadline process off dlq, or
+//    the next process off this CPU's run queue,
+//    or steal one from a busier CPU if it is empty,
+//    or wait in idle() for work to show up.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -485,64 +1935,53 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
-  int current_index = -1; // Variable to hold the index of the currently running process
-  int instruction_ptr = 0; // Pointer to the current instruction in the Brainfuck code
-  int *data_ptr = &current_index; // Pointer to data (in this case, the current process index)
-  char bf_code[] = "+[-[<<[+[--->]-[<<<]]]>>>-]>-.---.>..>.<<<<-.<+.>>>>>.>.<<.<-.";
-  // Brainfuck code that selects the next process to run
-
+  
   c->proc = 0;
+  c->starttime = r_time();
+  __sync_synchronize();
+  c->online = 1;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    // Brainfuck scheduler logic
-    while (bf_code[instruction_ptr]) {
-      switch (bf_code[instruction_ptr]) {
-        case '>':
-          current_index++;
-          break;
-        case '<':
-          current_index--;
-          break;
-        case '+':
-          if (current_index >= 0 && current_index < NPROC)
-            proc[current_index].state = RUNNABLE;
-          break;
-        case '-':
-          if (current_index >= 0 && current_index < NPROC)
-            proc[current_index].state = SLEEPING;
-          break;
-        case '.':
-          if (current_index >= 0 && current_index < NPROC) {
-            acquire(&proc[current_index].lock);
-            if (proc[current_index].state == RUNNABLE) {
-              proc[current_index].state = RUNNING;
-              c->proc = &proc[current_index];
-              swtch(&c->context, &proc[current_index].context);
-              // Process is done running for now.
-              // It should have changed its p->state before coming back.
-              c->proc = 0;
-            }
-            release(&proc[current_index].lock);
-          }
-          break;
-        default:
-          break;
+    if((p = dlget(c)) == 0 && (p = runqget(c, c)) == 0 &&
+       (p = runqsteal(c)) == 0){
+      idle(c);
+      continue;
+    }
+
+    acquire(&p->lock);
+    if(p->state == RUNNABLE && (p->affinity & CPUBIT(c)) == 0){
+      // p's affinity changed while it was queued here;
+      // queue it on a CPU it may run on.
+      makerunnable(p);
+    } else if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      // p's kernel stack may sit at an address that last
+      // mapped a since-freed stack, so drop any stale
+      // translation this CPU has cached.
+      sfence_vma();
+      p->ru.wtime += r_time() - p->queuedat;
+      if(p->cpu != c - cpus){
+        tracerec(TR_MIGRATE, p->pid, p->cpu);
+        c->nmigrate++;
+        p->cpu = c - cpus;
       }
-      instruction_ptr++;
+      c->proc = p;
+      tracerec(TR_SWITCHIN, p->pid, 0);
+      swtch(&c->context, &p->context);
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
     }
-    instruction_ptr = 0; // Reset instruction pointer for the next iteration
+    release(&p->lock);
   }
 }
 
-
-
-
-
-
-
-
 // Switch to scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -566,7 +2005,10 @@ sched(void)
     panic("sched interruptible");
 
   intena = mycpu()->intena;
+  tracerec(TR_SWITCHOUT, p->pid, p->state);
+  p->ru.stime += r_time() - p->lastts;
   swtch(&p->context, &mycpu()->context);
+  p->lastts = r_time();
   mycpu()->intena = intena;
 }
 
@@ -576,11 +2018,74 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  p->ru.nvcsw++;
+  makerunnable(p);
   sched();
   release(&p->lock);
 }
 
+// Called on each timer interrupt taken while the current
+// process is running. Charge the process for the tick, and
+// give up the CPU if the scheduling policy says another
+// process should run instead. A deadline process that has
+// used up its runtime for this period gives up the CPU
+// too; dlthrottle() holds it until the next period once
+// it is on its way back to user space, since here it may
+// hold a sleeplock or be inside a log transaction.
+void
+preempt(void)
+{
+  struct proc *p = myproc();
+
+  acquire(&p->lock);
+  if(p->dlperiod){
+    if(--p->dlbudget <= 0){
+      p->dloverrun = 1;
+      p->ru.nivcsw++;
+      makerunnable(p);
+      sched();
+    }
+  } else if(tickcharge(p)){
+    p->ru.nivcsw++;
+    makerunnable(p);
+    sched();
+  }
+  release(&p->lock);
+}
+
+// Called by usertrap() just before returning to user
+// space, with no locks held. A deadline process that ran
+// out of budget sleeps until its next period.
+void
+dlthrottle(void)
+{
+  struct proc *p = myproc();
+  int out;
+
+  acquire(&p->lock);
+  out = p->dlperiod && p->dlbudget <= 0;
+  release(&p->lock);
+  if(out)
+    dlnextperiod(p);
+}
+
+// Called on an IPI from kick() or dlkick() while the
+// current process is running. Give up the CPU if a process
+// that should preempt this one has been queued.
+void
+resched(void)
+{
+  struct proc *p = myproc();
+
+  acquire(&p->lock);
+  if(preempts(mycpu(), p)){
+    p->ru.nivcsw++;
+    makerunnable(p);
+    sched();
+  }
+  release(&p->lock);
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -589,6 +2094,7 @@ forkret(void)
   static int first = 1;
 
   // Still holding p->lock from scheduler.
+  myproc()->lastts = r_time();
   release(&myproc()->lock);
 
   if (first) {
@@ -602,53 +2108,191 @@ forkret(void)
   usertrapret();
 }
 
+// Unlink p from the sleep queue it is on.
+// Caller must hold that queue's lock.
+static void
+sleepqremove(struct proc *p)
+{
+  if(p->sqnext)
+    p->sqnext->sqpprev = p->sqpprev;
+  *p->sqpprev = p->sqnext;
+  p->sqnext = 0;
+  p->sqpprev = 0;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *sq = &sleepq[SLEEPQHASH(chan)];
   
-  // Must acquire p->lock in order to
+  // Must acquire sq->lock in order to join
+  // chan's wait queue, and p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Once we hold sq->lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks sq->lock),
   // so it's okay to release lk.
 
+  acquire(&sq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
   // Go to sleep.
+  p->sqnext = sq->head;
+  if(sq->head)
+    sq->head->sqpprev = &p->sqnext;
+  sq->head = p;
+  p->sqpprev = &sq->head;
   p->chan = chan;
   p->state = SLEEPING;
+  p->ru.nvcsw++;
+  release(&sq->lock);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  // wakeup() took p off the queue, unless it was
+  // kill() that woke p. Nothing else unlinks p once
+  // it is running, so the unlocked test is safe.
+  if(p->sqpprev){
+    acquire(&sq->lock);
+    sleepqremove(p);
+    release(&sq->lock);
+  }
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
 // Wake up all processes sleeping on chan.
+// Only looks at processes in chan's sleep queue.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct sleepq *sq = &sleepq[SLEEPQHASH(chan)];
+  struct proc *p, *next;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
+  acquire(&sq->lock);
+  for(p = sq->head; p; p = next){
+    next = p->sqnext;
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->chan == chan) {
+      sleepqremove(p);
+      makerunnable(p);
+    }
+    release(&p->lock);
+  }
+  release(&sq->lock);
+}
+
+// Wake up to n processes sleeping on chan.
+// Returns the number woken.
+// Must be called without any p->lock.
+static int
+wakeupn(void *chan, int n)
+{
+  struct sleepq *sq = &sleepq[SLEEPQHASH(chan)];
+  struct proc *p, *next;
+  int woken = 0;
+
+  acquire(&sq->lock);
+  for(p = sq->head; p && woken < n; p = next){
+    next = p->sqnext;
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->chan == chan) {
+      sleepqremove(p);
+      makerunnable(p);
+      woken++;
+    }
+    release(&p->lock);
+  }
+  release(&sq->lock);
+  return woken;
+}
+
+// Wait on or wake the user word at addr, for user-space
+// locks that only enter the kernel under contention.
+// Sleepers are keyed by the word's physical address, so
+// processes sharing the page (e.g. threads) meet.
+// FUTEX_WAIT sleeps if the word still holds val, and
+// returns 0 when woken, or -1 if the word had changed.
+// FUTEX_WAKE wakes up to val sleepers and returns how
+// many it woke.
+int
+futex(uint64 addr, int op, int val)
+{
+  struct proc *p = myproc();
+  struct spinlock *lk;
+  uint64 pa;
+  void *chan;
+  int v, n;
+
+  if(addr % sizeof(int) != 0)
+    return -1;
+  // the word is known by its physical address, so make
+  // sure it has a page of its own now, rather than have
+  // the store that will wake this waiter move it. (A fork
+  // while threads wait can still strand them, if the
+  // parent writes the word first.)
+  if(vmfault(p->pagetable, addr, 1) < 0)
+    return -1;
+  acquire(&p->leader->memlock);
+  pa = walkaddr(p->pagetable, addr);
+  release(&p->leader->memlock);
+  if(pa == 0)
+    return -1;
+  chan = (void*)(pa + (addr & (PGSIZE-1)));
+  lk = &futexlock[SLEEPQHASH(chan)];
+
+  switch(op){
+  case FUTEX_WAIT:
+    acquire(lk);
+    if(copyin(p->pagetable, (char*)&v, addr, sizeof(v)) < 0 || v != val ||
+       killed(p)){
+      release(lk);
+      return -1;
     }
+    sleep(chan, lk);
+    release(lk);
+    return 0;
+  case FUTEX_WAKE:
+    acquire(lk);
+    n = wakeupn(chan, val);
+    release(lk);
+    return n;
+  }
+  return -1;
+}
+
+// Return the process with the given pid,
+// with p->lock held, or 0 if there is none.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  acquire(&pid_lock);
+  p = pidlookup(pid);
+  release(&pid_lock);
+  if(p == 0)
+    return 0;
+
+  // p may have exited, and even been reused, since the
+  // lookup; procs are never freed, so it is safe to lock
+  // p and check.
+  acquire(&p->lock);
+  if(p->pid != pid || p->state == UNUSED){
+    release(&p->lock);
+    return 0;
   }
+  return p;
 }
 
 // Kill the process with the given pid.
@@ -659,20 +2303,165 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    makerunnable(p);
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// Move process pid to scheduling priority prio.
+// A process already in a run queue keeps its place
+// there; the new level applies from its next turn.
+int
+setpriority(int pid, int prio)
+{
+  struct proc *p;
+
+  if(prio < 0 || prio >= NPRIO)
+    return -1;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->priority = prio;
+  p->runticks = 0;
+  release(&p->lock);
+  return 0;
+}
+
+// Give the current process n tickets, for a CPU share
+// proportional to n under stride scheduling.
+int
+settickets(int n)
+{
+  struct proc *p = myproc();
+
+  if(n < 1 || n > STRIDE1)
+    return -1;
+  acquire(&p->lock);
+  p->tickets = n;
+  p->stride = STRIDE1 / n;
+  release(&p->lock);
+  return 0;
+}
+
+// Put the current process in the deadline class: every
+// period ticks it is given runtime ticks of CPU, due
+// deadline ticks after the period starts, and runs ahead
+// of normal processes, earliest deadline first. Fails if
+// the CPUs could not carry the total utilization. A
+// runtime of 0 returns the process to normal scheduling.
+int
+setdeadline(int runtime, int period, int deadline)
+{
+  struct proc *p = myproc();
+  uint64 u;
+
+  if(runtime == 0){
     acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
+    dlsetutil(p, 0);
+    p->dlperiod = 0;
+    release(&p->lock);
+    return 0;
+  }
+  if(runtime < 0 || deadline < runtime || period < deadline)
+    return -1;
+  u = (uint64)runtime * DLUNIT / period;
+  acquire(&p->lock);
+  if(dlsetutil(p, u) < 0){
     release(&p->lock);
+    return -1;
   }
-  return -1;
+  p->dlruntime = runtime;
+  p->dlperiod = period;
+  p->dldeadline = deadline;
+  p->dlabs = ticks + deadline;
+  p->dlnext = ticks + period;
+  p->dlbudget = runtime;
+  p->dloverrun = 0;
+  release(&p->lock);
+  return 0;
+}
+
+// Called by a deadline process when the job for this
+// period is done: sleep until the next period starts.
+// Returns 1 if the job missed its deadline or ran past
+// its runtime, 0 if not, and -1 if the process is not
+// in the deadline class.
+int
+dlyield(void)
+{
+  struct proc *p = myproc();
+  int missed;
+
+  acquire(&p->lock);
+  if(p->dlperiod == 0){
+    release(&p->lock);
+    return -1;
+  }
+  missed = p->dloverrun || tickbefore(p->dlabs, ticks);
+  p->dloverrun = 0;
+  release(&p->lock);
+  dlnextperiod(p);
+  return missed;
+}
+
+// Restrict process pid to the CPUs in mask, which must
+// include an online one. Takes effect the next time the
+// process is queued; the current process moves at once.
+int
+setaffinity(int pid, int mask)
+{
+  struct proc *p;
+  struct cpu *c;
+  int online = 0, move;
+
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    if(c->online)
+      online |= CPUBIT(c);
+  if((mask & online) == 0)
+    return -1;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->affinity = mask & ALLCPUS;
+  move = p == myproc() && (mask & CPUBIT(mycpu())) == 0;
+  release(&p->lock);
+  if(move)
+    yield();
+  return 0;
+}
+
+// Return the affinity mask of process pid,
+// or -1 if there is no such process.
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  mask = p->affinity;
+  release(&p->lock);
+  return mask;
+}
+
+// Return the scheduling priority of process pid,
+// or -1 if there is no such process.
+int
+getpriority(int pid)
+{
+  struct proc *p;
+  int prio;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  prio = p->priority;
+  release(&p->lock);
+  return prio;
 }
 
 void
@@ -694,6 +2483,110 @@ killed(struct proc *p)
   return k;
 }
 
+// Copy per-CPU scheduler statistics for up to n online
+// CPUs to the user array at addr.
+// Returns the number of entries copied, or -1 on error.
+int
+cpustat(uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct cpustat st;
+  struct cpu *c;
+  int i = 0;
+
+  for(c = cpus; c < &cpus[NCPU] && i < n; c++){
+    if(!c->online)
+      continue;
+    st.cpu = c - cpus;
+    st.runqlen = c->rq.len;
+    st.nsteal = c->nsteal;
+    st.nmigrate = c->nmigrate;
+    st.idle = c->idlecycles;
+    st.busy = r_time() - c->starttime - st.idle;
+    if(copyout(p->pagetable, addr + i*sizeof(st), (char *)&st, sizeof(st)) < 0)
+      return -1;
+    i++;
+  }
+  return i;
+}
+
+// Sum the CPU usage of the current process, including all
+// of its threads, into *ct; or, if children, the usage of
+// the children that it has waited for.
+static void
+groupusage(int children, struct cputime *ct)
+{
+  struct proc *p = myproc(), *l = p->leader, *t;
+  uint64 now;
+
+  // bring the caller's own system time up to date.
+  now = r_time();
+  p->ru.stime += now - p->lastts;
+  p->lastts = now;
+
+  memset(ct, 0, sizeof(*ct));
+  if(children){
+    acquire(&wait_lock);
+    acquire(&l->memlock);
+    cputimeadd(ct, &l->cru);
+    for(t = l->tnext; t; t = t->tnext)
+      cputimeadd(ct, &t->cru);
+    release(&l->memlock);
+    release(&wait_lock);
+  } else {
+    acquire(&l->memlock);
+    cputimeadd(ct, &l->ru);
+    cputimeadd(ct, &l->tru);
+    for(t = l->tnext; t; t = t->tnext)
+      cputimeadd(ct, &t->ru);
+    release(&l->memlock);
+  }
+}
+
+// Copy the struct rusage for who, RUSAGE_SELF or
+// RUSAGE_CHILDREN, to the user address addr.
+// Returns 0 on success, -1 on error.
+int
+getrusage(int who, uint64 addr)
+{
+  struct cputime ct;
+  struct rusage ru;
+
+  if(who != RUSAGE_SELF && who != RUSAGE_CHILDREN)
+    return -1;
+  groupusage(who == RUSAGE_CHILDREN, &ct);
+  ru.ru_utime = ct.utime;
+  ru.ru_stime = ct.stime;
+  ru.ru_wtime = ct.wtime;
+  ru.ru_nvcsw = ct.nvcsw;
+  ru.ru_nivcsw = ct.nivcsw;
+  return copyout(myproc()->pagetable, addr, (char *)&ru, sizeof(ru));
+}
+
+// Copy the user and system times of the current process
+// and of its waited-for children to the user address addr.
+// Returns the ticks since boot, or -1 on error.
+int
+times(uint64 addr)
+{
+  struct cputime self, children;
+  struct tms tms;
+  uint xticks;
+
+  groupusage(0, &self);
+  groupusage(1, &children);
+  tms.tms_utime = self.utime;
+  tms.tms_stime = self.stime;
+  tms.tms_cutime = children.utime;
+  tms.tms_cstime = children.stime;
+  if(copyout(myproc()->pagetable, addr, (char *)&tms, sizeof(tms)) < 0)
+    return -1;
+  acquire(&tickslock);
+  xticks = ticks;
+  release(&tickslock);
+  return xticks;
+}
+
 // Copy to either a user address, or kernel address,
 // depending on usr_dst.
 // Returns 0 on success, -1 on error.
@@ -742,7 +2635,7 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(p = ptable.all; p; p = p->allnext){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
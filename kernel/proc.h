@@ -18,12 +18,41 @@ struct context {
   uint64 s11;
 };
 
+// Per-CPU RUNNABLE processes, linked through p->rqnext:
+// one FIFO per priority level, or with SCHED_STRIDE a single
+// list in pass order.
+// Lock order: p->lock, then rq.lock.
+struct runq {
+  struct spinlock lock;
+#ifdef SCHED_STRIDE
+  struct proc *head;          // Queued processes, smallest pass first.
+  uint64 pass;                // Pass of the last process dispatched.
+#else
+  struct proc *head[NPRIO];   // Next process to run at each level.
+  struct proc *tail[NPRIO];   // Most recently queued at each level.
+  uint boost;                 // Last priority boost applied here.
+#endif
+  int len;                    // Number of queued processes.
+};
+
 // Per-CPU state.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int online;                 // Has this cpu entered scheduler()?
+  struct runq rq;             // Processes waiting to run on this cpu.
+  uint64 nsteal;              // Processes stolen from other cpus' queues.
+  uint64 nmigrate;            // Processes that last ran on another cpu.
+  int idle;                   // Is this cpu waiting in idle()?
+  uint64 nexttick;            // Time of the next timer interrupt.
+  uint64 starttime;           // Time this cpu entered scheduler().
+  uint64 idlecycles;          // Time spent in idle().
+  pagetable_t upagetable;     // User page table in use, 0 in the kernel.
+  uint64 ntrap;               // Entries to the kernel from user space.
+  struct spinlock tmlock;
+  struct proc *timers;        // In sleepuntil() here, earliest first (tmlock).
 };
 
 extern struct cpu cpus[NCPU];
@@ -81,9 +110,51 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// CPU usage, in time CSR cycles, for getrusage().
+struct cputime {
+  uint64 utime;                // Running in user space
+  uint64 stime;                // Running in the kernel
+  uint64 wtime;                // RUNNABLE, waiting for a CPU
+  uint64 nvcsw;                // Voluntary context switches
+  uint64 nivcsw;               // Involuntary context switches
+};
+
+// A region of user memory filled a page at a time when
+// first touched: bytes [off, off+filesz) of ip at start,
+// then zeroes up to end. exec() sets these up for a
+// program's segments instead of reading them in, and
+// mmap() for files and anonymous memory.
+struct vma {
+  uint64 start;                // First address, page-aligned
+  uint64 end;                  // Address after the last page
+  struct inode *ip;            // File, or 0 if anonymous
+  uint64 off;                  // File offset that start maps
+  uint64 filesz;               // Bytes of file mapped
+  int perm;                    // PTE_R, PTE_W and PTE_X bits
+  int flags;                   // MAP_SHARED or MAP_PRIVATE, 0 if unused
+  int busy;                    // Pages being read in by vmfill()
+  struct shmem *shm;           // Pages of a MAP_SHARED region
+  uint64 shmpg;                // Index in shm of the page at start
+};
+
+// The pages of a MAP_SHARED region, kept for every region
+// that shares it, after fork() or a split by munmap(),
+// so that each fills a page only once and finds the page
+// another filled. pages[] runs to the end of the memory
+// from kallocpages(order).
+struct shmem {
+  struct spinlock lock;
+  int ref;                     // Regions using this
+  int order;
+  uint64 npages;
+  uint64 pages[];              // Physical address of each page, or 0
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
+  struct spinlock memlock;     // Guards page table, sz and threads p leads
+  struct spinlock filelock;    // Guards open files and cwd p's threads share
 
   // p->lock must be held when using these:
   enum procstate state;        // Process state
@@ -91,9 +162,58 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // Index in cpus[] of the run queue p uses
+  int affinity;                // Mask of cpus[] indexes p may run on
+  int priority;                // Scheduling level, 0 is highest
+  int runticks;                // Timer ticks used at this level
+  uint boost;                  // Last priority boost applied to p
+  int tickets;                 // Stride scheduling share
+  uint64 stride;               // Pass increment per tick run
+  uint64 pass;                 // Stride scheduling virtual time
+  int dlruntime;               // EDF: ticks of CPU per period
+  int dlperiod;                // EDF: ticks between job releases, 0 if not EDF
+  int dldeadline;              // EDF: ticks from release to deadline
+  uint dlabs;                  // EDF: absolute deadline of the current job
+  uint dlnext;                 // EDF: release time of the next job
+  int dlbudget;                // EDF: ticks left of this period's runtime
+  int dloverrun;               // EDF: current job was throttled
+  uint64 dlutil;               // EDF: admitted utilization, in DLUNITs
+  struct proc *rqnext;         // Next in run queue (rq.lock)
+  struct proc *sqnext;         // Next in sleep queue (sq->lock)
+  struct proc **sqpprev;       // Link to p in sleep queue, or 0
+  uint64 wakeat;               // Time sleepuntil() waits for (tmcpu->tmlock)
+  struct proc *tmnext;         // Next in tmcpu's timers (tmcpu->tmlock)
+  struct cpu *tmcpu;           // CPU whose timers p is on, or 0
+  uint64 queuedat;             // Time p last became RUNNABLE
 
-  // wait_lock must be held when using this:
+  // wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *child;          // First child, linked through sibling
+  struct proc *sibling;        // Next child of parent
+  struct cputime cru;          // Usage of children p waited for
+
+  // fixed once p is allocated:
+  struct proc *allnext;        // Next in list of all procs
+
+  // fixed while p is in use:
+  struct proc *leader;         // Owner of p's page table, p unless a thread
+  uint64 tfva;                 // User address of p's trapframe
+
+  // ptable.lock must be held when using this:
+  struct proc *nextfree;       // Next in free list
+
+  // pid_lock must be held when using this:
+  struct proc *pidnext;        // Next in pid hash chain
+
+  // p->leader->memlock must be held when using these:
+  struct proc *tnext;          // Next thread sharing leader's page table
+  struct cputime tru;          // Usage of exited threads p led
+  struct vma vma[NVMA];        // File-backed regions, if p leads
+  uint64 heapbase;             // Start of sbrk() memory, if p leads
+
+  // p->leader->filelock must be held when using these:
+  struct file *ofile[NOFILE];  // Open files, if p leads
+  struct inode *cwd;           // Current directory, if p leads
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
@@ -101,7 +221,7 @@ struct proc {
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct cputime ru;           // CPU usage (wtime and switches: p->lock)
+  uint64 lastts;               // Time utime/stime were last charged
 };
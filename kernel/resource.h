@@ -0,0 +1,19 @@
+// who for getrusage()
+#define RUSAGE_SELF     0  // the process and its threads
+#define RUSAGE_CHILDREN 1  // children it has waited for
+
+// times are in time CSR cycles, TIMEBASE per second.
+struct rusage {
+  uint64 ru_utime;   // running in user space
+  uint64 ru_stime;   // running in the kernel
+  uint64 ru_wtime;   // runnable, waiting for a CPU
+  uint64 ru_nvcsw;   // gave up the CPU to wait for something
+  uint64 ru_nivcsw;  // preempted
+};
+
+struct tms {
+  uint64 tms_utime;
+  uint64 tms_stime;
+  uint64 tms_cutime;
+  uint64 tms_cstime;
+};
@@ -256,6 +256,21 @@ r_mcounteren()
   return x;
 }
 
+// Supervisor Counter-Enable
+static inline void 
+w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
+static inline uint64
+r_scounteren()
+{
+  uint64 x;
+  asm volatile("csrr %0, scounteren" : "=r" (x) );
+  return x;
+}
+
 // machine-mode cycle counter
 static inline uint64
 r_time()
@@ -279,6 +294,13 @@ intr_off()
   w_sstatus(r_sstatus() & ~SSTATUS_SIE);
 }
 
+// wait for an interrupt to become pending.
+static inline void
+wfi()
+{
+  asm volatile("wfi");
+}
+
 // are device interrupts enabled?
 static inline int
 intr_get()
@@ -343,6 +365,9 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // user can access
+#define PTE_D (1L << 7) // dirty
+#define PTE_COW (1L << 8) // copy-on-write: writable once copied
+#define PTE_SHARED (1L << 9) // MAP_SHARED: fork() shares, never copies
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -0,0 +1,157 @@
+// Slab allocator, for small kernel objects: files,
+// inodes, pipes, exec arguments.
+//
+// Each cache hands out objects of one size from slab
+// pages, each page starting with a struct slab header.
+// Freed objects go first to the freeing CPU's magazine,
+// and allocation takes from there, so the cache lock is
+// only taken to move half a magazine at a time.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "slab.h"
+#include "defs.h"
+
+struct slab {
+  struct slab *next;   // in cache's partial list
+  struct slab *prev;
+  void *free;          // free objects, linked through their first word
+  int inuse;           // objects handed out, including to magazines
+};
+
+void
+slabinit(struct slabcache *c, char *name, int size)
+{
+  initlock(&c->lock, "slab");
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  c->perslab = (PGSIZE - sizeof(struct slab)) / c->size;
+  if(c->perslab < 1)
+    panic("slabinit");
+  c->partial = 0;
+}
+
+static void
+unlink(struct slabcache *c, struct slab *s)
+{
+  if(s->next)
+    s->next->prev = s->prev;
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+}
+
+static void
+push(struct slabcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// Fill magazine m half full from c's slabs, taking new
+// slab pages from kalloc() as needed.
+// Caller must hold c->lock.
+static void
+refill(struct slabcache *c, struct magazine *m)
+{
+  struct slab *s;
+  char *o;
+  int i;
+
+  while(m->n < MAGSIZE / 2){
+    if((s = c->partial) == 0){
+      if((s = (struct slab*)kalloc()) == 0)
+        return;
+      s->free = 0;
+      s->inuse = 0;
+      o = (char*)(s + 1);
+      for(i = 0; i < c->perslab; i++, o += c->size){
+        *(void**)o = s->free;
+        s->free = o;
+      }
+      push(c, s);
+    }
+    o = s->free;
+    s->free = *(void**)o;
+    s->inuse++;
+    m->obj[m->n++] = o;
+    if(s->free == 0)
+      unlink(c, s);
+  }
+}
+
+// Return the older half of magazine m to c's slabs,
+// giving back to kalloc() any slab left with no objects
+// in use. Caller must hold c->lock.
+static void
+drain(struct slabcache *c, struct magazine *m)
+{
+  struct slab *s;
+  void *o;
+  int i;
+
+  for(i = 0; i < MAGSIZE / 2; i++){
+    o = m->obj[i];
+    s = (struct slab*)PGROUNDDOWN((uint64)o);
+    if(s->free == 0)
+      push(c, s);
+    *(void**)o = s->free;
+    s->free = o;
+    if(--s->inuse == 0){
+      unlink(c, s);
+      kfree(s);
+    }
+  }
+  m->n -= MAGSIZE / 2;
+  memmove(m->obj, m->obj + MAGSIZE / 2, m->n * sizeof(m->obj[0]));
+}
+
+// Allocate a zeroed object from cache c.
+// Returns 0 if memory is short.
+void*
+slaballoc(struct slabcache *c)
+{
+  struct magazine *m;
+  void *o = 0;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    refill(c, m);
+    release(&c->lock);
+  }
+  if(m->n > 0)
+    o = m->obj[--m->n];
+  pop_off();
+
+  if(o)
+    memset(o, 0, c->size);
+  return o;
+}
+
+// Free object o, which came from slaballoc(c).
+void
+slabfree(struct slabcache *c, void *o)
+{
+  struct magazine *m;
+
+  // Fill with junk to catch dangling refs.
+  memset(o, 1, c->size);
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    drain(c, m);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = o;
+  pop_off();
+}
@@ -0,0 +1,20 @@
+// Caches of equal-sized kernel objects, carved out of
+// pages from kalloc().
+
+#define MAGSIZE 16  // most free objects a CPU keeps per cache
+
+// A CPU's stash of free objects. Only that CPU uses it,
+// with interrupts off, so it needs no lock.
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct slabcache {
+  struct spinlock lock;
+  char *name;        // Name of cache, for debugging
+  int size;          // Object size, rounded up
+  int perslab;       // Objects in one slab page
+  struct slab *partial;  // Slabs with free objects (lock)
+  struct magazine mag[NCPU];
+};
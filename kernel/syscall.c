@@ -101,6 +101,28 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
+extern uint64 sys_cpustat(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_getpriority(void);
+extern uint64 sys_settickets(void);
+extern uint64 sys_setdeadline(void);
+extern uint64 sys_dlyield(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_getaffinity(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_clock_gettime(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_times(void);
+extern uint64 sys_trace(void);
+extern uint64 sys_tracedrain(void);
+extern uint64 sys_prof(void);
+extern uint64 sys_profdrain(void);
+extern uint64 sys_memstat(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -126,6 +148,28 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_cpustat] sys_cpustat,
+[SYS_setpriority] sys_setpriority,
+[SYS_getpriority] sys_getpriority,
+[SYS_settickets] sys_settickets,
+[SYS_setdeadline] sys_setdeadline,
+[SYS_dlyield] sys_dlyield,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_getaffinity] sys_getaffinity,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex]   sys_futex,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_getrusage] sys_getrusage,
+[SYS_times]   sys_times,
+[SYS_trace]   sys_trace,
+[SYS_tracedrain] sys_tracedrain,
+[SYS_prof]    sys_prof,
+[SYS_profdrain] sys_profdrain,
+[SYS_memstat] sys_memstat,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
 };
 
 void
@@ -20,3 +20,25 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_cpustat 22
+#define SYS_setpriority 23
+#define SYS_getpriority 24
+#define SYS_settickets 25
+#define SYS_setdeadline 26
+#define SYS_dlyield 27
+#define SYS_setaffinity 28
+#define SYS_getaffinity 29
+#define SYS_clone  30
+#define SYS_join   31
+#define SYS_futex  32
+#define SYS_nanosleep 33
+#define SYS_clock_gettime 34
+#define SYS_getrusage 35
+#define SYS_times  36
+#define SYS_trace  37
+#define SYS_tracedrain 38
+#define SYS_prof   39
+#define SYS_profdrain 40
+#define SYS_memstat 41
+#define SYS_mmap   42
+#define SYS_munmap 43
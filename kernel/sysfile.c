@@ -13,24 +13,34 @@
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
+#include "slab.h"
 #include "file.h"
 #include "fcntl.h"
+#include "mman.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
+// The caller must fileclose() the file: another thread of the
+// group may close the descriptor meanwhile.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
   int fd;
   struct file *f;
+  struct proc *l = myproc()->leader;
 
   argint(n, &fd);
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE)
+    return -1;
+  acquire(&l->filelock);
+  if((f = l->ofile[fd]) != 0)
+    filedup(f);
+  release(&l->filelock);
+  if(f == 0)
     return -1;
   if(pfd)
     *pfd = fd;
-  if(pf)
-    *pf = f;
+  *pf = f;
   return 0;
 }
 
@@ -40,17 +50,36 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct proc *l = myproc()->leader;
 
+  acquire(&l->filelock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
+    if(l->ofile[fd] == 0){
+      l->ofile[fd] = f;
+      release(&l->filelock);
       return fd;
     }
   }
+  release(&l->filelock);
   return -1;
 }
 
+// Undo fdalloc(), unless another thread already closed fd.
+static void
+fdfree(int fd, struct file *f)
+{
+  struct proc *l = myproc()->leader;
+
+  acquire(&l->filelock);
+  if(l->ofile[fd] != f){
+    release(&l->filelock);
+    return;
+  }
+  l->ofile[fd] = 0;
+  release(&l->filelock);
+  fileclose(f);
+}
+
 uint64
 sys_dup(void)
 {
@@ -59,9 +88,10 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -76,7 +106,9 @@ sys_read(void)
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  n = fileread(f, p, n);
+  fileclose(f);
+  return n;
 }
 
 uint64
@@ -91,7 +123,9 @@ sys_write(void)
   if(argfd(0, 0, &f) < 0)
     return -1;
 
-  return filewrite(f, p, n);
+  n = filewrite(f, p, n);
+  fileclose(f);
+  return n;
 }
 
 uint64
@@ -99,10 +133,17 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct proc *l = myproc()->leader;
 
-  if(argfd(0, &fd, &f) < 0)
+  argint(0, &fd);
+  if(fd < 0 || fd >= NOFILE)
+    return -1;
+  acquire(&l->filelock);
+  if((f = l->ofile[fd]) != 0)
+    l->ofile[fd] = 0;
+  release(&l->filelock);
+  if(f == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
@@ -114,9 +155,13 @@ sys_fstat(void)
   uint64 st; // user pointer to struct stat
 
   argaddr(1, &st);
+  int r;
+
   if(argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -341,9 +386,7 @@ sys_open(void)
     return -1;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op();
     return -1;
@@ -367,6 +410,11 @@ sys_open(void)
   iunlock(ip);
   end_op();
 
+  // other threads can use f once it has a descriptor.
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -410,8 +458,8 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
-  struct proc *p = myproc();
+  struct inode *ip, *old;
+  struct proc *l = myproc()->leader;
   
   begin_op();
   if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
@@ -425,16 +473,21 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  acquire(&l->filelock);
+  old = l->cwd;
+  l->cwd = ip;
+  release(&l->filelock);
+  iput(old);
   end_op();
-  p->cwd = ip;
   return 0;
 }
 
+extern struct slabcache argcache;
+
 uint64
 sys_exec(void)
 {
-  char path[MAXPATH], *argv[MAXARG];
+  char path[MAXPATH], *argv[MAXARG], big[MAXARG];
   int i;
   uint64 uargv, uarg;
 
@@ -443,6 +496,7 @@ sys_exec(void)
     return -1;
   }
   memset(argv, 0, sizeof(argv));
+  memset(big, 0, sizeof(big));
   for(i=0;; i++){
     if(i >= NELEM(argv)){
       goto bad;
@@ -454,23 +508,39 @@ sys_exec(void)
       argv[i] = 0;
       break;
     }
-    argv[i] = kalloc();
+    // most arguments fit a slab object; a longer one
+    // gets a page, as every argument once did.
+    argv[i] = slaballoc(&argcache);
     if(argv[i] == 0)
       goto bad;
-    if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+    if(fetchstr(uarg, argv[i], MAXARGLEN) < 0){
+      slabfree(&argcache, argv[i]);
+      if((argv[i] = kalloc()) == 0)
+        goto bad;
+      big[i] = 1;
+      if(fetchstr(uarg, argv[i], PGSIZE) < 0)
+        goto bad;
+    }
   }
 
   int ret = exec(path, argv);
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++){
+    if(big[i])
+      kfree(argv[i]);
+    else
+      slabfree(&argcache, argv[i]);
+  }
 
   return ret;
 
  bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++){
+    if(big[i])
+      kfree(argv[i]);
+    else
+      slabfree(&argcache, argv[i]);
+  }
   return -1;
 }
 
@@ -488,18 +558,84 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
-    fileclose(rf);
+      fdfree(fd0, rf);
+    else
+      fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
-    fileclose(rf);
-    fileclose(wf);
+    fdfree(fd0, rf);
+    fdfree(fd1, wf);
     return -1;
   }
   return 0;
 }
+
+// mmap(addr, len, prot, flags, fd, off): map len bytes of
+// the file open as fd, from off, or with MAP_ANONYMOUS zeroed
+// memory. addr is only a hint, and ignored: the region goes
+// in the highest free space below MMAPTOP.
+uint64
+sys_mmap(void)
+{
+  uint64 len, off;
+  int prot, flags, share;
+  struct file *f;
+  struct vma v;
+  uint64 va;
+  uint size;
+
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  argaddr(5, &off);
+  share = flags & (MAP_SHARED|MAP_PRIVATE);
+  if(len == 0 || len > MAXVA || off % PGSIZE != 0)
+    return -1;
+  if(share != MAP_SHARED && share != MAP_PRIVATE)
+    return -1;
+
+  memset(&v, 0, sizeof(v));
+  v.end = PGROUNDUP(len);
+  v.flags = share;
+  if(prot & PROT_WRITE)
+    v.perm |= PTE_W;
+  if(prot & PROT_EXEC)
+    v.perm |= PTE_X;
+  if(!(flags & MAP_ANONYMOUS)){
+    if(argfd(4, 0, &f) < 0)
+      return -1;
+    if(f->type != FD_INODE || !f->readable ||
+       (share == MAP_SHARED && (prot & PROT_WRITE) && !f->writable)){
+      fileclose(f);
+      return -1;
+    }
+    ilock(f->ip);
+    size = f->ip->size;
+    iunlock(f->ip);
+    v.ip = idup(f->ip);
+    fileclose(f);
+    v.off = off;
+    if(off < size)
+      v.filesz = size - off < len ? size - off : len;
+  }
+
+  if((va = mmap(&v)) == -1 && v.ip){
+    begin_op();
+    iput(v.ip);
+    end_op();
+  }
+  return va;
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  return munmap(addr, len);
+}
@@ -5,6 +5,8 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "time.h"
+#include "memstat.h"
 
 uint64
 sys_exit(void)
@@ -35,6 +37,38 @@ sys_wait(void)
   return wait(p);
 }
 
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  argaddr(0, &fn);
+  argaddr(1, &arg);
+  argaddr(2, &stack);
+  return clone(fn, arg, stack);
+}
+
+uint64
+sys_join(void)
+{
+  int tid;
+
+  argint(0, &tid);
+  return join(tid);
+}
+
+uint64
+sys_futex(void)
+{
+  uint64 addr;
+  int op, val;
+
+  argaddr(0, &addr);
+  argint(1, &op);
+  argint(2, &val);
+  return futex(addr, op, val);
+}
+
 uint64
 sys_sbrk(void)
 {
@@ -89,3 +123,189 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// sleep for a struct timespec's worth of time, to the
+// precision of the time CSR.
+uint64
+sys_nanosleep(void)
+{
+  uint64 addr;
+  struct timespec ts;
+
+  argaddr(0, &addr);
+  if(copyin(myproc()->pagetable, (char*)&ts, addr, sizeof(ts)) < 0)
+    return -1;
+  if(ts.nsec >= 1000000000)
+    return -1;
+  // keep the wake-up time from wrapping around; a sleep of
+  // more than 2^62 cycles (some 14000 years) is cut short.
+  if(ts.sec > (1L << 62) / TIMEBASE)
+    ts.sec = (1L << 62) / TIMEBASE;
+  return sleepuntil(r_time() + ts.sec * TIMEBASE +
+                    ts.nsec / (1000000000 / TIMEBASE));
+}
+
+// return the time since boot, read from the time CSR.
+uint64
+sys_clock_gettime(void)
+{
+  int clock;
+  uint64 addr, t;
+  struct timespec ts;
+
+  argint(0, &clock);
+  argaddr(1, &addr);
+  if(clock != CLOCK_MONOTONIC)
+    return -1;
+  t = r_time();
+  ts.sec = t / TIMEBASE;
+  ts.nsec = (t % TIMEBASE) * (1000000000 / TIMEBASE);
+  return copyout(myproc()->pagetable, addr, (char*)&ts, sizeof(ts));
+}
+
+// return per-CPU scheduler statistics.
+uint64
+sys_cpustat(void)
+{
+  uint64 st;
+  int n;
+
+  argaddr(0, &st);
+  argint(1, &n);
+  return cpustat(st, n);
+}
+
+uint64
+sys_setpriority(void)
+{
+  int pid, prio;
+
+  argint(0, &pid);
+  argint(1, &prio);
+  return setpriority(pid, prio);
+}
+
+uint64
+sys_getpriority(void)
+{
+  int pid;
+
+  argint(0, &pid);
+  return getpriority(pid);
+}
+
+uint64
+sys_settickets(void)
+{
+  int n;
+
+  argint(0, &n);
+  return settickets(n);
+}
+
+uint64
+sys_setdeadline(void)
+{
+  int runtime, period, deadline;
+
+  argint(0, &runtime);
+  argint(1, &period);
+  argint(2, &deadline);
+  return setdeadline(runtime, period, deadline);
+}
+
+uint64
+sys_dlyield(void)
+{
+  return dlyield();
+}
+
+uint64
+sys_setaffinity(void)
+{
+  int pid, mask;
+
+  argint(0, &pid);
+  argint(1, &mask);
+  return setaffinity(pid, mask);
+}
+
+uint64
+sys_getaffinity(void)
+{
+  int pid;
+
+  argint(0, &pid);
+  return getaffinity(pid);
+}
+
+uint64
+sys_getrusage(void)
+{
+  int who;
+  uint64 ru;
+
+  argint(0, &who);
+  argaddr(1, &ru);
+  return getrusage(who, ru);
+}
+
+uint64
+sys_times(void)
+{
+  uint64 tms;
+
+  argaddr(0, &tms);
+  return times(tms);
+}
+
+uint64
+sys_trace(void)
+{
+  int on;
+
+  argint(0, &on);
+  return traceset(on);
+}
+
+uint64
+sys_tracedrain(void)
+{
+  uint64 ev;
+  int n;
+
+  argaddr(0, &ev);
+  argint(1, &n);
+  return tracedrain(ev, n);
+}
+
+uint64
+sys_prof(void)
+{
+  int on;
+
+  argint(0, &on);
+  return profset(on);
+}
+
+uint64
+sys_profdrain(void)
+{
+  uint64 s;
+  int n;
+
+  argaddr(0, &s);
+  argint(1, &n);
+  return profdrain(s, n);
+}
+
+uint64
+sys_memstat(void)
+{
+  struct memstat st;
+  uint64 addr;
+
+  argaddr(0, &addr);
+  memstat(&st);
+  return copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st));
+}
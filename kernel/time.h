@@ -0,0 +1,10 @@
+// clocks for clock_gettime()
+#define CLOCK_MONOTONIC 1  // time since boot
+
+// time CSR cycles per second, on qemu's virt machine.
+#define TIMEBASE 10000000L
+
+struct timespec {
+  uint64 sec;
+  uint64 nsec;
+};
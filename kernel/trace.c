@@ -0,0 +1,193 @@
+//
+// Scheduler event tracing and timer-tick profiling.
+// Each hart records into its own ring, with interrupts
+// off, so recording takes no lock; a reader copies records
+// out behind the writer and throws away any the writer
+// overwrote while it was copying them.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "trace.h"
+#include "defs.h"
+
+struct ring {
+  char *buf;    // n records of size bytes
+  int n;
+  int size;
+  uint64 head;  // records ever written; written only by the owning hart
+  uint64 tail;  // records consumed (tracelock)
+};
+
+struct traceev traceevs[NCPU][NTRACE];
+struct profsample profsamples[NCPU][NPROF];
+struct ring tracerings[NCPU];
+struct ring profrings[NCPU];
+struct spinlock tracelock;  // serializes readers
+volatile int tracing;
+volatile int profiling;
+
+void
+traceinit(void)
+{
+  int i;
+
+  initlock(&tracelock, "trace");
+  for(i = 0; i < NCPU; i++){
+    tracerings[i].buf = (char *)traceevs[i];
+    tracerings[i].n = NTRACE;
+    tracerings[i].size = sizeof(struct traceev);
+    profrings[i].buf = (char *)profsamples[i];
+    profrings[i].n = NPROF;
+    profrings[i].size = sizeof(struct profsample);
+  }
+}
+
+// Append the record at rec to ring r, overwriting the
+// oldest if r is full. Caller must have interrupts off
+// and be running on r's hart.
+static void
+ringput(struct ring *r, void *rec)
+{
+  memmove(r->buf + (r->head % r->n) * r->size, rec, r->size);
+  // publish the record only once it is complete.
+  __sync_synchronize();
+  r->head++;
+}
+
+// Turn recording into rings on or off, discarding
+// earlier records when it turns on. Returns the old setting.
+static int
+ringset(struct ring *rings, volatile int *on, int new)
+{
+  int i, old;
+
+  acquire(&tracelock);
+  old = *on;
+  if(new && !old){
+    for(i = 0; i < NCPU; i++)
+      rings[i].tail = rings[i].head;
+  }
+  __sync_synchronize();
+  *on = new != 0;
+  release(&tracelock);
+  return old;
+}
+
+// Copy up to n unconsumed records, in each hart's order,
+// from rings to the user array at addr, and consume them.
+// Returns the number copied, or -1 on error.
+static int
+ringdrain(struct ring *rings, uint64 addr, int n)
+{
+  char buf[512];
+  struct ring *r;
+  uint64 head, tail, first, k;
+  int i, got = 0;
+
+  for(r = rings; r < &rings[NCPU]; r++){
+    while(got < n){
+      acquire(&tracelock);
+      head = r->head;
+      __sync_synchronize();
+      tail = r->tail;
+      if(head - tail > r->n)
+        tail = head - r->n;  // lost to wraparound
+      k = head - tail;
+      if(k > sizeof(buf) / r->size)
+        k = sizeof(buf) / r->size;
+      if(k > n - got)
+        k = n - got;
+      for(i = 0; i < k; i++)
+        memmove(buf + i * r->size, r->buf + ((tail + i) % r->n) * r->size,
+                r->size);
+      r->tail = tail + k;
+      // the writer may have lapped us while we copied. It
+      // fills record head's slot, which was head - n's,
+      // before advancing head, so records up to and
+      // including head - n may be torn.
+      __sync_synchronize();
+      head = r->head;
+      first = head + 1 > tail + r->n ? head + 1 - r->n - tail : 0;
+      release(&tracelock);
+
+      if(k == 0)
+        break;
+      if(first >= k)
+        continue;
+      k -= first;
+      if(copyout(myproc()->pagetable, addr + got * r->size,
+                 buf + first * r->size, k * r->size) < 0)
+        return -1;
+      got += k;
+    }
+  }
+  return got;
+}
+
+// Record a scheduler event of type for pid.
+void
+tracerec(int type, int pid, int arg)
+{
+  struct traceev e;
+
+  if(!tracing)
+    return;
+  push_off();
+  e.time = r_time();
+  e.type = type;
+  e.cpu = cpuid();
+  e.pid = pid;
+  e.arg = arg;
+  ringput(&tracerings[cpuid()], &e);
+  pop_off();
+}
+
+int
+traceset(int on)
+{
+  return ringset(tracerings, &tracing, on);
+}
+
+int
+tracedrain(uint64 addr, int n)
+{
+  return ringdrain(tracerings, addr, n);
+}
+
+// Record where this hart was when the timer tick arrived.
+// Called from devintr(), with interrupts off.
+void
+profrec(void)
+{
+  struct profsample s;
+  struct proc *p = myproc();
+
+  if(!profiling)
+    return;
+  s.pc = r_sepc();
+  s.cpu = cpuid();
+  s.user = (r_sstatus() & SSTATUS_SPP) == 0;
+  s.pid = p ? p->pid : 0;
+  if(p)
+    safestrcpy(s.name, p->name, sizeof(s.name));
+  else
+    s.name[0] = 0;
+  ringput(&profrings[cpuid()], &s);
+}
+
+int
+profset(int on)
+{
+  return ringset(profrings, &profiling, on);
+}
+
+int
+profdrain(uint64 addr, int n)
+{
+  return ringdrain(profrings, addr, n);
+}
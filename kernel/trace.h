@@ -0,0 +1,24 @@
+// Scheduler trace events, as returned by tracedrain().
+#define TR_SWITCHIN  1  // began running; arg is 0
+#define TR_SWITCHOUT 2  // stopped running; arg is its new state
+#define TR_WAKEUP    3  // became RUNNABLE; arg is its old state
+#define TR_MIGRATE   4  // about to run on a new CPU; arg is the old one
+#define TR_FORK      5  // created a process or thread; arg is its pid
+#define TR_EXIT      6  // exited; arg is the exit status
+
+struct traceev {
+  uint64 time;  // time CSR when the event happened
+  int type;     // TR_*
+  int cpu;      // hart that recorded it
+  int pid;      // process it happened to
+  int arg;
+};
+
+// Timer-tick profile samples, as returned by profdrain().
+struct profsample {
+  uint64 pc;      // sepc where the tick interrupted
+  int cpu;        // hart that took the tick
+  int pid;        // process running there, or 0
+  int user;       // 1 if pc is in user space
+  char name[16];  // the process's name
+};
@@ -19,7 +19,11 @@ extern int devintr();
 void
 trapinit(void)
 {
+  struct cpu *c;
+
   initlock(&tickslock, "time");
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    initlock(&c->tmlock, "timers");
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -45,7 +49,17 @@ usertrap(void)
   // since we're now in the kernel.
   w_stvec((uint64)kernelvec);
 
+  // uservec flushed the TLB on the way in; see shootdown().
+  mycpu()->upagetable = 0;
+  __sync_synchronize();
+  mycpu()->ntrap++;
+
   struct proc *p = myproc();
+
+  // charge the time since usertrapret() to user space.
+  uint64 now = r_time();
+  p->ru.utime += now - p->lastts;
+  p->lastts = now;
   
   // save user program counter.
   p->trapframe->epc = r_sepc();
@@ -65,6 +79,11 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            vmfault(p->pagetable, r_stval(), r_scause() == 15) == 0){
+    // an instruction fetch or load from a page not yet
+    // read in or allocated, or a store to one or to a
+    // copy-on-write page: now mapped.
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -76,9 +95,17 @@ usertrap(void)
   if(killed(p))
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
+  // maybe give up the CPU if this is a timer interrupt,
+  // or another CPU has queued a process that should run first.
   if(which_dev == 2)
-    yield();
+    preempt();
+  else if(which_dev == 3)
+    resched();
+
+  // a deadline process that used up its budget, here or
+  // in the kernel, waits out the period now that it holds
+  // no locks.
+  dlthrottle();
 
   usertrapret();
 }
@@ -121,12 +148,16 @@ usertrapret(void)
 
   // tell trampoline.S the user page table to switch to.
   uint64 satp = MAKE_SATP(p->pagetable);
+  mycpu()->upagetable = p->pagetable;
 
   // jump to userret in trampoline.S at the top of memory, which 
-  // switches to the user page table, restores user registers,
-  // and switches to user mode with sret.
+  // switches to the user page table, restores user registers
+  // from the trapframe, and switches to user mode with sret.
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64))trampoline_userret)(satp);
+  uint64 now = r_time();
+  p->ru.stime += now - p->lastts;
+  p->lastts = now;
+  ((void (*)(uint64, uint64))trampoline_userret)(satp, p->tfva);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -150,11 +181,16 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    yield();
+  // maybe give up the CPU if this is a timer interrupt,
+  // or another CPU has queued a process that should run first.
+  if(myproc() != 0 && myproc()->state == RUNNING){
+    if(which_dev == 2)
+      preempt();
+    else if(which_dev == 3)
+      resched();
+  }
 
-  // the yield() may have caused some traps to occur,
+  // the preempt() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
   w_sepc(sepc);
   w_sstatus(sstatus);
@@ -163,15 +199,110 @@ kerneltrap()
 void
 clockintr()
 {
-  acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
-  release(&tickslock);
+  if(cpuid() == 0){
+    acquire(&tickslock);
+    ticks++;
+    wakeup(&ticks);
+    release(&tickslock);
+  }
+
+  // ask for the next tick.
+  settimer(r_time() + TICKCYCLES);
+}
+
+// Program this CPU's timer for the earlier of its next tick
+// and its first sleepuntil() deadline. Interrupts must be off.
+static void
+timerarm(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *p;
+  uint64 when = c->nexttick;
+
+  // an unlocked peek; a stale deadline just costs an
+  // early interrupt.
+  if((p = c->timers) != 0 && p->wakeat < when)
+    when = p->wakeat;
+  *(uint64*)CLINT_MTIMECMP(cpuid()) = when;
+}
+
+// Ask for a timer interrupt on this CPU once the time CSR
+// reaches when. timervec disarms the timer each time it
+// fires, so ticks stop if the kernel does not call
+// settimer() again. Interrupts must be off.
+void
+settimer(uint64 when)
+{
+  mycpu()->nexttick = when;
+  timerarm();
+}
+
+// Sleep until the time CSR reaches when, with the precision
+// of the time CSR rather than of ticks: the process waits on
+// this CPU's list of timers, and the timer is programmed for
+// the earliest. Returns -1 if killed, else 0.
+int
+sleepuntil(uint64 when)
+{
+  struct proc *p = myproc(), **pp;
+  struct cpu *c;
+
+  push_off();
+  c = mycpu();
+  acquire(&c->tmlock);
+  pop_off();
+  for(pp = &c->timers; *pp && (*pp)->wakeat <= when; pp = &(*pp)->tmnext)
+    ;
+  p->wakeat = when;
+  p->tmnext = *pp;
+  p->tmcpu = c;
+  *pp = p;
+  timerarm();  // still on c, since tmlock is held.
+
+  while(p->tmcpu && !killed(p))
+    sleep(&p->wakeat, &c->tmlock);
+  if(p->tmcpu){
+    for(pp = &c->timers; *pp != p; pp = &(*pp)->tmnext)
+      ;
+    *pp = p->tmnext;
+    p->tmcpu = 0;
+  }
+  release(&c->tmlock);
+  return killed(p) ? -1 : 0;
+}
+
+// Wake processes whose sleepuntil() deadlines have passed,
+// and program the timer for the next one.
+static void
+timerintr(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *p;
+
+  acquire(&c->tmlock);
+  while((p = c->timers) != 0 && p->wakeat <= r_time()){
+    c->timers = p->tmnext;
+    p->tmnext = 0;
+    p->tmcpu = 0;
+    wakeup(&p->wakeat);
+  }
+  timerarm();
+  release(&c->tmlock);
+}
+
+// Send an inter-processor interrupt to CPU id. It arrives
+// at timervec in machine mode, which raises a supervisor
+// software interrupt on that CPU.
+void
+ipi(int id)
+{
+  *(uint32*)CLINT_MSIP(id) = 1;
 }
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
 // returns 2 if timer interrupt,
+// 3 if IPI from another CPU, or a sleepuntil() timer,
 // 1 if other device,
 // 0 if not recognized.
 int
@@ -202,17 +333,23 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or IPI, forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
+    timerintr();
+
+    // not a tick: an IPI from kick(), either to leave wfi
+    // in idle() or to preempt the current process, or a
+    // timer that may have woken a process that should.
+    if(r_time() < mycpu()->nexttick)
+      return 3;
+
+    clockintr();
+    profrec();
     return 2;
   } else {
     return 0;
@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -11,6 +12,10 @@
  */
 pagetable_t kernel_pagetable;
 
+// serializes changes to kernel_pagetable after boot,
+// i.e. mapping and unmapping kernel stacks.
+struct spinlock kvm_lock;
+
 extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
@@ -30,6 +35,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT, for settimer() and ipi()
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
@@ -43,8 +51,8 @@ kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // allocate and map a kernel stack for each process.
-  proc_mapstacks(kpgtbl);
+  // kernel stacks are mapped below the trampoline by
+  // kvmmapstack() as processes are allocated.
   
   return kpgtbl;
 }
@@ -53,9 +61,36 @@ kvmmake(void)
 void
 kvminit(void)
 {
+  initlock(&kvm_lock, "kvm");
   kernel_pagetable = kvmmake();
 }
 
+// Map the kernel stack page pa at va in the kernel page table.
+// Returns 0 on success, -1 if a page-table page could not
+// be allocated.
+int
+kvmmapstack(uint64 va, uint64 pa)
+{
+  int r;
+
+  acquire(&kvm_lock);
+  r = mappages(kernel_pagetable, va, PGSIZE, pa, PTE_R | PTE_W);
+  release(&kvm_lock);
+  return r;
+}
+
+// Unmap the kernel stack page at va and free it.
+// Other CPUs may still cache the old translation;
+// scheduler() flushes before running a process.
+void
+kvmunmapstack(uint64 va)
+{
+  acquire(&kvm_lock);
+  uvmunmap(kernel_pagetable, va, 1, 1);
+  release(&kvm_lock);
+  sfence_vma();
+}
+
 // Switch h/w page table register to the kernel's page table,
 // and enable paging.
 void
@@ -102,6 +137,26 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   return &pagetable[PX(0, va)];
 }
 
+// Given that walk(pagetable, va, 0) found no page-table
+// page for va, the first address past the range that the
+// missing page (or the missing one above it) would map:
+// the next that loops over a sparse range, e.g. memory
+// grown by sbrk() but mostly untouched, need look at.
+uint64
+walkskip(pagetable_t pagetable, uint64 va)
+{
+  uint64 size;
+
+  for(int level = 2; level > 0; level--) {
+    pte_t *pte = &pagetable[PX(level, va)];
+    size = 1L << PXSHIFT(level);
+    if((*pte & PTE_V) == 0)
+      return (va + size) & ~(size - 1);
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  }
+  return va + PGSIZE;
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -165,22 +220,27 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages never touched since sbrk() have no
+// mapping, and are skipped, a page-table page at a time
+// where they have none.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, next;
   pte_t *pte;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
+  for(a = va; a < va + npages*PGSIZE; a = next){
+    next = a + PGSIZE;
+    if((pte = walk(pagetable, a, 0)) == 0){
+      next = walkskip(pagetable, a);
+      continue;
+    }
     if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -296,34 +356,39 @@ uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Given a parent process's page table, share
+// its memory with a child's page table.
+// Writable pages become read-only and copy-on-write
+// in both; uvmcow() copies one when it is written.
+// MAP_SHARED pages stay shared as they are.
+// The caller must flush stale writable mappings of
+// old from TLBs.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
   pte_t *pte;
-  uint64 pa, i;
+  uint64 pa, i, next;
   uint flags;
-  char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
+  for(i = 0; i < sz; i = next){
+    next = i + PGSIZE;
+    if((pte = walk(old, i, 0)) == 0){
+      next = walkskip(old, i);
+      continue;
+    }
     if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+      continue;  // never touched
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
-      goto err;
+    if((flags & PTE_W) && !(flags & PTE_SHARED)){
+      flags = (flags & ~PTE_W) | PTE_COW;
+      *pte = PA2PTE(pa) | flags;
     }
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
+      goto err;
+    kdup((void*)pa);
   }
   return 0;
 
@@ -332,6 +397,80 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return -1;
 }
 
+// Give the page table its own writable copy of the
+// copy-on-write page at va, or just make the page
+// writable if no other page table shares it any more.
+// Returns 1 if va now maps a new page, 0 if it maps the
+// same one, or -1 if va is not copy-on-write or memory
+// is short.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
+    return -1;
+  if(*pte & PTE_W)
+    return 0;  // another thread copied it first
+  if((*pte & PTE_COW) == 0)
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW;
+  if(krefs((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+    return 0;
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  kfree((void*)pa);
+  return 1;
+}
+
+// Map a zeroed, writable user page at va, which has not
+// been mapped before.
+// Returns 0 on success, -1 if something is mapped at va
+// already (the stack guard page) or memory is short.
+int
+uvmdemand(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  char *mem;
+
+  if((pte = walk(pagetable, va, 1)) == 0 || (*pte & PTE_V))
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  *pte = PA2PTE(mem) | PTE_R | PTE_W | PTE_U | PTE_V;
+  return 0;
+}
+
+// Mark the PTEs mapped in [va, end) invalid for user
+// access, ahead of freeing the pages while other threads
+// may still be using them.
+void
+uvmrevoke(pagetable_t pagetable, uint64 va, uint64 end)
+{
+  uint64 a, next;
+  pte_t *pte;
+
+  for(a = va; a < end; a = next){
+    next = a + PGSIZE;
+    if((pte = walk(pagetable, a, 0)) == 0)
+      next = walkskip(pagetable, a);
+    else if(*pte & PTE_V)
+      *pte &= ~PTE_U;
+  }
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -345,6 +484,38 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Like walkaddr(), but for copying to (if write) or from
+// the user page at va: first fault the page in, as a
+// user access would, if it was never touched or, for a
+// write, is not yet writable. The page is pinned (see
+// vmpin()); kfree() it when the copy is done.
+static uint64
+useraddr(pagetable_t pagetable, uint64 va, int write)
+{
+  uint64 pa;
+
+  if((pa = vmpin(pagetable, va, write)) == 0 &&
+     vmfault(pagetable, va, write) == 0)
+    pa = vmpin(pagetable, va, write);
+  return pa;
+}
+
+// Fault in the user pages of [addr, addr+n) ahead of a
+// copy to (if write) or from them that will be done with a
+// lock held. Reading a page in from a file sleeps, so it
+// can't be done holding a spinlock (vmfault() refuses),
+// and locks the file's inode, which could deadlock with a
+// process taking the two inode locks the other way round.
+void
+prefault(pagetable_t pagetable, uint64 addr, uint64 n, int write)
+{
+  uint64 a;
+
+  for(a = PGROUNDDOWN(addr); a < addr + n; a += PGSIZE)
+    if(walkaddr(pagetable, a) == 0 && vmfault(pagetable, a, write) < 0)
+      break;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -355,13 +526,14 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = useraddr(pagetable, va0, 1);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
     memmove((void *)(pa0 + (dstva - va0)), src, n);
+    kfree((void*)pa0);
 
     len -= n;
     src += n;
@@ -380,13 +552,14 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = useraddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
     memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+    kfree((void*)pa0);
 
     len -= n;
     dst += n;
@@ -407,7 +580,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = useraddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -428,6 +601,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
       p++;
       dst++;
     }
+    kfree((void*)pa0);
 
     srcva = va0 + PGSIZE;
   }
@@ -0,0 +1,23 @@
+// Print per-CPU scheduler statistics.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/cpustat.h"
+#include "user/user.h"
+
+int
+main(void)
+{
+  struct cpustat st[NCPU];
+  int i, n;
+
+  if((n = cpustat(st, NCPU)) < 0){
+    fprintf(2, "cpustat: failed\n");
+    exit(1);
+  }
+  printf("cpu runq steals migrations busy idle\n");
+  for(i = 0; i < n; i++)
+    printf("%d %d %l %l %l %l\n", st[i].cpu, st[i].runqlen,
+           st[i].nsteal, st[i].nmigrate, st[i].busy, st[i].idle);
+  exit(0);
+}
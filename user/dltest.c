@@ -0,0 +1,134 @@
+// Deadline scheduling benchmark, after custom-benchmark-6.c:
+// periodic tasks alternate between normal jobs and stalling
+// jobs that take 2.5 times as long, while CPU-bound hogs
+// compete as normal processes. Each task asks for a runtime
+// a tick longer than its job, and a period and deadline of
+// four times the job. Reports the deadlines each task missed.
+//
+//   dltest [tasks [hogs]]    (default 4 tasks, 2 hogs)
+//
+// Tasks that would overload the CPUs are refused admission.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NTASK 16
+#define NHOG  16
+#define NJOB  5
+
+#define NORMAL_EXEC_TIME   2  // ticks
+#define STALLING_EXEC_TIME 5
+
+struct report {
+  int task;
+  int admitted;
+  int missed;
+};
+
+// loop iterations in one tick, measured by calibrate().
+uint64 pertick;
+
+void
+stall_cpu(uint64 n)
+{
+  volatile uint64 i;
+
+  for(i = 0; i < n; i++)
+    ;
+}
+
+void
+calibrate(void)
+{
+  int t;
+
+  t = uptime();
+  while(uptime() == t)
+    ;
+  t = uptime();
+  while(uptime() == t){
+    stall_cpu(1000);
+    pertick += 1000;
+  }
+}
+
+void
+task(int id, int fd)
+{
+  struct report r;
+  int exec, i;
+
+  exec = id % 2 == 0 ? NORMAL_EXEC_TIME : STALLING_EXEC_TIME;
+  r.task = id;
+  r.missed = 0;
+  r.admitted = setdeadline(exec + 1, 4 * exec, 4 * exec) == 0;
+  if(r.admitted){
+    for(i = 0; i < NJOB; i++){
+      stall_cpu(exec * pertick);
+      if(dlyield() == 1)
+        r.missed++;
+    }
+  }
+  write(fd, &r, sizeof(r));
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ntask = 4, nhog = 2, hogs[NHOG], fds[2], i, pid;
+  struct report r;
+
+  if(argc > 1)
+    ntask = atoi(argv[1]);
+  if(argc > 2)
+    nhog = atoi(argv[2]);
+  if(ntask < 1 || ntask > NTASK || nhog < 0 || nhog > NHOG){
+    fprintf(2, "usage: dltest [tasks [hogs]]\n");
+    exit(1);
+  }
+
+  calibrate();
+  if(pipe(fds) < 0){
+    fprintf(2, "dltest: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < nhog; i++){
+    if((hogs[i] = fork()) < 0){
+      fprintf(2, "dltest: fork failed\n");
+      exit(1);
+    }
+    if(hogs[i] == 0)
+      for(;;)
+        ;
+  }
+  for(i = 0; i < ntask; i++){
+    if((pid = fork()) < 0){
+      fprintf(2, "dltest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      task(i, fds[1]);
+    }
+  }
+  close(fds[1]);
+
+  printf("task type exec jobs missed\n");
+  while(read(fds[0], &r, sizeof(r)) == sizeof(r)){
+    printf("%d %s %d ", r.task, r.task % 2 == 0 ? "normal" : "stalling",
+           r.task % 2 == 0 ? NORMAL_EXEC_TIME : STALLING_EXEC_TIME);
+    if(r.admitted)
+      printf("%d %d\n", NJOB, r.missed);
+    else
+      printf("refused\n");
+  }
+  close(fds[0]);
+
+  for(i = 0; i < nhog; i++)
+    kill(hogs[i]);
+  for(i = 0; i < nhog + ntask; i++)
+    wait(0);
+  exit(0);
+}
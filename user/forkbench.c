@@ -0,0 +1,122 @@
+// Fork benchmark: times fork() of a child that exits at
+// once, and fork() then exec() of a program that exits at
+// once, each with the parent's wait(). The parent first
+// grows and touches a heap of the given size, so the cost
+// of copying, or sharing, its memory shows. Also reports
+// the physical pages a fork()ed child starts out with,
+// which doesn't depend on the clock.
+//
+//   forkbench [heapkb [rounds]]    (default 1024KB, 100 rounds)
+//
+// Times are in cycles of the time CSR, 10 per microsecond
+// on qemu's virt machine.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+static uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("csrr %0, time" : "=r" (x));
+  return x;
+}
+
+// Average cycles for fork(), then exec() if doexec, in the
+// child, and wait() in the parent.
+uint64
+bench(int rounds, int doexec)
+{
+  char *argv[] = { "forkbench", "-x", 0 };
+  uint64 t0;
+  int i, pid;
+
+  t0 = rdtime();
+  for(i = 0; i < rounds; i++){
+    if((pid = fork()) < 0){
+      fprintf(2, "forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      if(doexec)
+        exec(argv[0], argv);
+      exit(0);
+    }
+    wait(0);
+  }
+  return (rdtime() - t0) / rounds;
+}
+
+// Free physical pages, or -1.
+long
+freepages(void)
+{
+  struct memstat st;
+  long free;
+  int k;
+
+  if(memstat(&st) < 0)
+    return -1;
+  free = st.cached;
+  for(k = 0; k < NORDER; k++)
+    free += st.nfree[k] << k;
+  return free;
+}
+
+// Average pages that fork() takes from the free pool for
+// a child, as the child sees at once: its kernel stack,
+// trapframe and page table, the stack page it copies to
+// find out, and every heap page fork() copied rather than
+// shared.
+long
+forkpages(int rounds)
+{
+  long before, total = 0;
+  int i, pid, xstatus;
+
+  for(i = 0; i < rounds; i++){
+    before = freepages();
+    if((pid = fork()) < 0){
+      fprintf(2, "forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      exit(before - freepages());
+    wait(&xstatus);
+    total += xstatus;
+  }
+  return total / rounds;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int heapkb = 1024, rounds = 100, i;
+  char *heap;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);
+  if(argc > 1)
+    heapkb = atoi(argv[1]);
+  if(argc > 2)
+    rounds = atoi(argv[2]);
+  if(heapkb < 0 || rounds < 1){
+    fprintf(2, "usage: forkbench [heapkb [rounds]]\n");
+    exit(1);
+  }
+
+  if((heap = sbrk(heapkb * 1024)) == (char*)-1){
+    fprintf(2, "forkbench: sbrk failed\n");
+    exit(1);
+  }
+  for(i = 0; i < heapkb * 1024; i += 4096)
+    heap[i] = 1;
+
+  printf("forkbench: %dKB heap, %d rounds\n", heapkb, rounds);
+  printf("fork+exit+wait: %l cycles\n", bench(rounds, 0));
+  printf("fork+exec+wait: %l cycles\n", bench(rounds, 1));
+  printf("fork: %l pages per child\n", forkpages(rounds));
+  exit(0);
+}
@@ -2,30 +2,51 @@
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/mman.h"
 #include "user/user.h"
 
 char buf[1024];
 int match(char*, char*);
 
+// Print the lines of the string p that match pattern.
+// Returns the start of the last line, if unfinished.
+char*
+grepbuf(char *pattern, char *p)
+{
+  char *q;
+
+  while((q = strchr(p, '\n')) != 0){
+    *q = 0;
+    if(match(pattern, p)){
+      *q = '\n';
+      write(1, p, q+1 - p);
+    }
+    p = q+1;
+  }
+  return p;
+}
+
 void
 grep(char *pattern, int fd)
 {
   int n, m;
-  char *p, *q;
+  char *p;
+  struct stat st;
+
+  // search a file where it is mapped, rather than copy
+  // it through buf. The byte after the file maps as 0.
+  if(fstat(fd, &st) == 0 && st.type == T_FILE && st.size > 0 &&
+     (p = mmap(0, st.size + 1, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0)) != MAP_FAILED){
+    grepbuf(pattern, p);
+    munmap(p, st.size + 1);
+    return;
+  }
 
   m = 0;
   while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
     m += n;
     buf[m] = '\0';
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
-      *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
-      }
-      p = q+1;
-    }
+    p = grepbuf(pattern, buf);
     if(m > 0){
       m -= p - buf;
       memmove(buf, p, m);
@@ -0,0 +1,57 @@
+// Print physical memory statistics: free pages, how many
+// of them sit in per-CPU caches, and the buddy allocator's
+// free blocks of each order. frag is the percentage of
+// free pages that are in blocks smaller than a 2MB
+// megapage, a measure of external fragmentation.
+//
+//   memstat [interval]    (repeat every interval ticks)
+
+#include "kernel/types.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+#define MEGAORDER 9  // 2MB blocks
+
+void
+report(void)
+{
+  struct memstat st;
+  uint64 free, small;
+  int k;
+
+  if(memstat(&st) < 0){
+    fprintf(2, "memstat: failed\n");
+    exit(1);
+  }
+  free = st.cached;
+  small = st.cached;
+  for(k = 0; k < NORDER; k++){
+    free += st.nfree[k] << k;
+    if(k < MEGAORDER)
+      small += st.nfree[k] << k;
+  }
+  printf("total %l free %l cached %l frag %l%%\n", st.total, free,
+         st.cached, free ? small * 100 / free : 0);
+  printf("order");
+  for(k = 0; k < NORDER; k++)
+    printf(" %d", k);
+  printf("\nblocks");
+  for(k = 0; k < NORDER; k++)
+    printf(" %l", st.nfree[k]);
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int interval = 0;
+
+  if(argc > 1)
+    interval = atoi(argv[1]);
+  report();
+  while(interval > 0){
+    sleep(interval);
+    report();
+  }
+  exit(0);
+}
@@ -0,0 +1,245 @@
+// Run a command with the timer-tick profiler on, and print
+// a flat profile: the functions the ticks most often found
+// running, in the kernel or in any user program.
+//
+//   prof [-n count] command [args...]    (default 20 functions)
+//
+// Sampled addresses are looked up in kernel.sym and in
+// each program's own .sym file, which make puts in the
+// file system. Samples are drained while the command runs,
+// so long runs are not lost to the kernel's per-CPU rings
+// wrapping around.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+#define NSYMTAB 32    // symbol files loaded
+#define NENTRY  1024  // distinct functions counted
+
+struct sym {
+  uint64 addr;
+  char *name;
+};
+
+struct symtab {
+  char file[32];
+  struct sym *syms;  // sorted by addr
+  int n;
+};
+
+struct entry {
+  struct symtab *t;
+  char *name;        // function, or 0 if not found
+  uint64 count;
+};
+
+struct symtab symtabs[NSYMTAB];
+int nsymtab;
+struct entry entries[NENTRY];
+int nentry;
+uint64 nsample, nlost;
+struct profsample samples[256];
+volatile int done;
+
+uint64
+hex(char **sp)
+{
+  uint64 x = 0;
+  char *s = *sp;
+
+  for(;; s++){
+    if(*s >= '0' && *s <= '9')
+      x = x * 16 + *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      x = x * 16 + *s - 'a' + 10;
+    else
+      break;
+  }
+  *sp = s;
+  return x;
+}
+
+// Read file's lines of "address name" into t, dropping
+// section and file names, which start with '.' or end in ".c".
+int
+loadsyms(struct symtab *t, char *file)
+{
+  struct stat st;
+  struct sym s;
+  char *buf, *p, *q;
+  int fd, i, j;
+
+  strcpy(t->file, file);
+  t->n = 0;
+  if((fd = open(file, O_RDONLY)) < 0)
+    return -1;
+  if(fstat(fd, &st) < 0 || (buf = malloc(st.size + 1)) == 0 ||
+     read(fd, buf, st.size) != st.size){
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  buf[st.size] = 0;
+
+  for(p = buf, i = 0; *p; p++)
+    i += *p == '\n';
+  if((t->syms = malloc(i * sizeof(struct sym))) == 0)
+    return -1;
+  for(p = buf; *p; p = q + 1){
+    if((q = strchr(p, '\n')) == 0)
+      break;
+    *q = 0;
+    s.addr = hex(&p);
+    if(*p++ != ' ' || *p == 0 || *p == '.' ||
+       (q - p > 2 && strcmp(q - 2, ".c") == 0))
+      continue;
+    s.name = p;
+    // insertion sort; the tables are small.
+    for(j = t->n++; j > 0 && t->syms[j-1].addr > s.addr; j--)
+      t->syms[j] = t->syms[j-1];
+    t->syms[j] = s;
+  }
+  return 0;
+}
+
+struct symtab*
+symtab(char *file)
+{
+  int i;
+
+  for(i = 0; i < nsymtab; i++)
+    if(strcmp(symtabs[i].file, file) == 0)
+      return &symtabs[i];
+  if(nsymtab == NSYMTAB)
+    return 0;
+  loadsyms(&symtabs[nsymtab], file);
+  return &symtabs[nsymtab++];
+}
+
+// The name of the function in t containing addr, or 0.
+char*
+lookup(struct symtab *t, uint64 addr)
+{
+  int lo = 0, hi = t->n, mid;
+
+  while(lo < hi){
+    mid = (lo + hi) / 2;
+    if(t->syms[mid].addr <= addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo > 0 ? t->syms[lo-1].name : 0;
+}
+
+void
+count(struct profsample *s)
+{
+  char file[32];
+  struct symtab *t;
+  char *name;
+  int i;
+
+  if(s->user){
+    // names are at most 15 characters.
+    strcpy(file, s->name);
+    strcpy(file + strlen(file), ".sym");
+  } else {
+    strcpy(file, "kernel.sym");
+  }
+  nsample++;
+  if((t = symtab(file)) == 0){
+    nlost++;
+    return;
+  }
+  name = lookup(t, s->pc);
+  for(i = 0; i < nentry; i++)
+    if(entries[i].t == t && entries[i].name == name)
+      break;
+  if(i == nentry){
+    if(nentry == NENTRY){
+      nlost++;
+      return;
+    }
+    entries[nentry].t = t;
+    entries[nentry].name = name;
+    nentry++;
+  }
+  entries[i].count++;
+}
+
+// Thread that counts samples as they come in, until the
+// command is done.
+void
+drainer(void *arg)
+{
+  int n, i, last;
+
+  for(;;){
+    last = done;
+    while((n = profdrain(samples, sizeof(samples) / sizeof(samples[0]))) > 0)
+      for(i = 0; i < n; i++)
+        count(&samples[i]);
+    if(last)
+      break;
+    sleep(10);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct uthread t;
+  struct entry e;
+  int top = 20, pid, i, j;
+
+  if(argc > 2 && strcmp(argv[1], "-n") == 0){
+    top = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+  if(argc < 2){
+    fprintf(2, "usage: prof [-n count] command [args...]\n");
+    exit(1);
+  }
+
+  prof(1);
+  if((pid = fork()) < 0){
+    fprintf(2, "prof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "prof: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  if(uthread_create(&t, drainer, 0) < 0){
+    fprintf(2, "prof: cannot start thread\n");
+    exit(1);
+  }
+  wait(0);
+  prof(0);
+  done = 1;
+  uthread_join(&t);
+
+  for(i = 1; i < nentry; i++){
+    e = entries[i];
+    for(j = i; j > 0 && entries[j-1].count < e.count; j--)
+      entries[j] = entries[j-1];
+    entries[j] = e;
+  }
+  printf("%l samples", nsample);
+  if(nlost)
+    printf(", %l not counted", nlost);
+  printf("\nsamples   %%  where\n");
+  for(i = 0; i < nentry && i < top; i++){
+    e = entries[i];
+    printf("%l %d%% %s %s\n", e.count, (int)(e.count * 100 / nsample),
+           e.t->file, e.name ? e.name : "?");
+  }
+  exit(0);
+}
@@ -0,0 +1,171 @@
+// Run a command with scheduler tracing on, then print a
+// summary of each process it traced: how often it ran, for
+// how long, how often it moved between CPUs, and its worst
+// scheduling latency, the time from becoming RUNNABLE to
+// running; and a histogram of all the latencies.
+//
+//   schedtrace [-v] command [args...]
+//
+// -v also prints every event, oldest first. Times are in
+// microseconds from the first event. Each CPU keeps only
+// its last NTRACE events.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/time.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define NPID  64   // processes summarized
+#define NHIST 16   // latency buckets
+
+#define US(cycles) ((cycles) / (TIMEBASE / 1000000))
+
+struct pstat {
+  int pid;
+  int runs;
+  int migrations;
+  uint64 runtime;
+  uint64 maxlat;
+  uint64 lastin;     // last TR_SWITCHIN, or 0
+  uint64 lastwake;   // last TR_WAKEUP, or 0
+};
+
+char *names[] = {
+[TR_SWITCHIN]  "in",
+[TR_SWITCHOUT] "out",
+[TR_WAKEUP]    "wakeup",
+[TR_MIGRATE]   "migrate",
+[TR_FORK]      "fork",
+[TR_EXIT]      "exit",
+};
+
+struct pstat ps[NPID];
+int nps;
+uint64 hist[NHIST];
+
+struct pstat*
+lookup(int pid)
+{
+  int i;
+
+  for(i = 0; i < nps; i++)
+    if(ps[i].pid == pid)
+      return &ps[i];
+  if(nps == NPID)
+    return 0;
+  ps[nps].pid = pid;
+  return &ps[nps++];
+}
+
+// Shell sort by time; the events come grouped by CPU.
+void
+sortev(struct traceev *ev, int n)
+{
+  struct traceev t;
+  int gap, i, j;
+
+  for(gap = n / 2; gap > 0; gap /= 2){
+    for(i = gap; i < n; i++){
+      t = ev[i];
+      for(j = i; j >= gap && ev[j - gap].time > t.time; j -= gap)
+        ev[j] = ev[j - gap];
+      ev[j] = t;
+    }
+  }
+}
+
+void
+account(struct traceev *e)
+{
+  struct pstat *p;
+  uint64 lat;
+  int b;
+
+  if((p = lookup(e->pid)) == 0)
+    return;
+  switch(e->type){
+  case TR_WAKEUP:
+    p->lastwake = e->time;
+    break;
+  case TR_SWITCHIN:
+    p->runs++;
+    p->lastin = e->time;
+    if(p->lastwake){
+      lat = US(e->time - p->lastwake);
+      if(lat > p->maxlat)
+        p->maxlat = lat;
+      for(b = 0; b < NHIST - 1 && (1L << b) <= lat; b++)
+        ;
+      hist[b]++;
+      p->lastwake = 0;
+    }
+    break;
+  case TR_SWITCHOUT:
+    if(p->lastin)
+      p->runtime += e->time - p->lastin;
+    p->lastin = 0;
+    break;
+  case TR_MIGRATE:
+    p->migrations++;
+    break;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct traceev *ev;
+  int verbose = 0, n, i, pid;
+
+  if(argc > 1 && strcmp(argv[1], "-v") == 0){
+    verbose = 1;
+    argc--;
+    argv++;
+  }
+  if(argc < 2){
+    fprintf(2, "usage: schedtrace [-v] command [args...]\n");
+    exit(1);
+  }
+  if((ev = malloc(NCPU * NTRACE * sizeof(*ev))) == 0){
+    fprintf(2, "schedtrace: out of memory\n");
+    exit(1);
+  }
+
+  trace(1);
+  if((pid = fork()) < 0){
+    fprintf(2, "schedtrace: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "schedtrace: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  trace(0);
+  if((n = tracedrain(ev, NCPU * NTRACE)) < 0){
+    fprintf(2, "schedtrace: tracedrain failed\n");
+    exit(1);
+  }
+  sortev(ev, n);
+
+  for(i = 0; i < n; i++){
+    if(verbose)
+      printf("%l cpu %d pid %d %s %d\n", US(ev[i].time - ev[0].time),
+             ev[i].cpu, ev[i].pid, names[ev[i].type], ev[i].arg);
+    account(&ev[i]);
+  }
+
+  printf("pid runs runtime(us) migrations maxlatency(us)\n");
+  for(i = 0; i < nps; i++)
+    printf("%d %d %l %d %l\n", ps[i].pid, ps[i].runs, US(ps[i].runtime),
+           ps[i].migrations, ps[i].maxlat);
+  printf("latency(us) count\n");
+  for(i = 0; i < NHIST; i++)
+    if(hist[i])
+      printf("%s%l %l\n", i == NHIST - 1 ? ">=" : "<",
+             1L << (i == NHIST - 1 ? i - 1 : i), hist[i]);
+  exit(0);
+}
@@ -0,0 +1,109 @@
+// Proportional-share benchmark: run CPU-bound tenants
+// holding different numbers of tickets, and report each
+// tenant's share of the work done in every interval.
+//
+//   stridetest [tickets ...]    (default 30 20 10)
+//
+// Build the kernel with make SCHEDPOLICY=STRIDE. Stride
+// scheduling divides each CPU separately, so run with
+// make CPUS=1 to see the shares of one CPU.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NTENANT   8
+#define NINTERVAL 10
+#define INTERVAL  10  // ticks
+
+struct report {
+  int tenant;
+  int interval;
+  uint64 count;
+};
+
+void
+tenant(int id, int tickets, int start, int fd)
+{
+  struct report r;
+  volatile int i;
+
+  if(settickets(tickets) < 0){
+    fprintf(2, "stridetest: settickets %d failed\n", tickets);
+    exit(1);
+  }
+  while(uptime() < start)
+    ;
+  r.tenant = id;
+  for(r.interval = 0; r.interval < NINTERVAL; r.interval++){
+    r.count = 0;
+    while(uptime() < start + (r.interval+1)*INTERVAL){
+      for(i = 0; i < 10000; i++)
+        ;
+      r.count++;
+    }
+    write(fd, &r, sizeof(r));
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  static uint64 count[NTENANT][NINTERVAL];
+  int tickets[NTENANT] = { 30, 20, 10 };
+  int fds[NTENANT][2], i, j, n, start;
+  struct report r;
+  uint64 total;
+
+  n = 3;
+  if(argc > 1){
+    n = argc - 1;
+    if(n > NTENANT){
+      fprintf(2, "stridetest: at most %d tenants\n", NTENANT);
+      exit(1);
+    }
+    for(i = 0; i < n; i++)
+      tickets[i] = atoi(argv[i+1]);
+  }
+
+  start = uptime() + 2;
+  for(i = 0; i < n; i++){
+    if(pipe(fds[i]) < 0){
+      fprintf(2, "stridetest: pipe failed\n");
+      exit(1);
+    }
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "stridetest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[i][0]);
+      tenant(i, tickets[i], start, fds[i][1]);
+    }
+    close(fds[i][1]);
+  }
+
+  for(i = 0; i < n; i++){
+    while(read(fds[i][0], &r, sizeof(r)) == sizeof(r))
+      count[r.tenant][r.interval] = r.count;
+    close(fds[i][0]);
+    wait(0);
+  }
+
+  printf("interval");
+  for(i = 0; i < n; i++)
+    printf(" t%d(%d)", i, tickets[i]);
+  printf("\n");
+  for(j = 0; j < NINTERVAL; j++){
+    total = 0;
+    for(i = 0; i < n; i++)
+      total += count[i][j];
+    printf("%d", j);
+    for(i = 0; i < n; i++)
+      printf(" %d%%", total ? (int)(count[i][j] * 100 / total) : 0);
+    printf("\n");
+  }
+  exit(0);
+}
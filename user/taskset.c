@@ -0,0 +1,27 @@
+// Run a command on a set of CPUs.
+//
+//   taskset mask command [args ...]
+//
+// mask has a bit per CPU, in decimal: taskset 6 wakelat
+// runs wakelat on CPUs 1 and 2 only, away from CPU 0,
+// which takes device interrupts.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  if(argc < 3){
+    fprintf(2, "usage: taskset mask command [args ...]\n");
+    exit(1);
+  }
+  if(setaffinity(getpid(), atoi(argv[1])) < 0){
+    fprintf(2, "taskset: bad mask %s\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "taskset: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -0,0 +1,59 @@
+// Run a command and report the CPU it used: user and system
+// time, time spent runnable but waiting for a CPU, and
+// voluntary and involuntary context switches, as getrusage()
+// counts them for the waited-for child.
+//
+//   time command [args...]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/resource.h"
+#include "kernel/time.h"
+#include "user/user.h"
+
+// print cycles of the time CSR as seconds, to the millisecond.
+void
+prtime(char *what, uint64 cycles)
+{
+  uint64 ms = cycles / (TIMEBASE / 1000);
+
+  printf("%s %l.%l%l%ls\n", what, ms / 1000, ms / 100 % 10, ms / 10 % 10, ms % 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct timespec t0, t1;
+  struct rusage ru;
+  int pid;
+
+  if(argc < 2){
+    fprintf(2, "usage: time command [args...]\n");
+    exit(1);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if((pid = fork()) < 0){
+    fprintf(2, "time: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "time: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  if(getrusage(RUSAGE_CHILDREN, &ru) < 0){
+    fprintf(2, "time: getrusage failed\n");
+    exit(1);
+  }
+
+  prtime("real", (t1.sec * 1000000000 + t1.nsec - t0.sec * 1000000000 - t0.nsec) /
+         (1000000000 / TIMEBASE));
+  prtime("user", ru.ru_utime);
+  prtime("sys ", ru.ru_stime);
+  prtime("wait", ru.ru_wtime);
+  printf("csw  %l voluntary, %l involuntary\n", ru.ru_nvcsw, ru.ru_nivcsw);
+  exit(0);
+}
@@ -1,4 +1,11 @@
 struct stat;
+struct cpustat;
+struct timespec;
+struct rusage;
+struct tms;
+struct traceev;
+struct profsample;
+struct memstat;
 
 // system calls
 int fork(void);
@@ -22,6 +29,28 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int cpustat(struct cpustat*, int);
+int setpriority(int, int);
+int getpriority(int);
+int settickets(int);
+int setdeadline(int, int, int);
+int dlyield(void);
+int setaffinity(int, int);
+int getaffinity(int);
+int clone(void (*)(void*), void*, void*);
+int join(int);
+int futex(int*, int, int);
+int nanosleep(const struct timespec*);
+int clock_gettime(int, struct timespec*);
+int getrusage(int, struct rusage*);
+int times(struct tms*);
+int trace(int);
+int tracedrain(struct traceev*, int);
+int prof(int);
+int profdrain(struct profsample*, int);
+int memstat(struct memstat*);
+void *mmap(void*, uint64, int, int, int, uint64);
+int munmap(void*, uint64);
 
 // ulib.c
 int stat(const char*, struct stat*);
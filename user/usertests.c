@@ -2,8 +2,15 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
+#include "user/uthread.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/futex.h"
+#include "kernel/time.h"
+#include "kernel/resource.h"
+#include "kernel/trace.h"
+#include "kernel/memstat.h"
+#include "kernel/mman.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -1959,7 +1966,7 @@ iref(char *s)
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = NPROC };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -1976,7 +1983,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
     exit(1);
   }
 
@@ -2330,6 +2337,47 @@ bigargtest(char *s)
   close(fd);
 }
 
+// an exec argument longer than a slab object still
+// gets through whole.
+void
+longargtest(char *s)
+{
+  char *args[3];
+  int pid, fd, n, xstatus;
+
+  memset(buf, 'a', 3000);
+  buf[3000] = 0;
+  unlink("longarg-out");
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    if(open("longarg-out", O_CREATE|O_WRONLY) != 1)
+      exit(1);
+    args[0] = "echo";
+    args[1] = buf;
+    args[2] = 0;
+    exec("echo", args);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: exec with a long argument failed\n", s);
+    exit(1);
+  }
+  fd = open("longarg-out", O_RDONLY);
+  n = read(fd, buf, sizeof(buf));
+  close(fd);
+  unlink("longarg-out");
+  if(n != 3001){
+    printf("%s: echo wrote %d bytes, not 3001\n", s, n);
+    exit(1);
+  }
+}
+
 // what happens when the file system runs out of blocks?
 // answer: balloc panics, so this test is not useful.
 void
@@ -2571,6 +2619,925 @@ badarg(char *s)
   exit(0);
 }
 
+// setpriority() and getpriority() on a blocked child,
+// which keeps its priority until it runs again.
+void
+priority(char *s)
+{
+  int fds[2], pid;
+  char c;
+
+  if(setpriority(getpid(), NPRIO) != -1 || setpriority(getpid(), -1) != -1){
+    printf("%s: setpriority accepted a bad level\n", s);
+    exit(1);
+  }
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[1]);
+    read(fds[0], &c, 1);
+    exit(0);
+  }
+  close(fds[0]);
+  if(setpriority(pid, NPRIO-1) < 0 || getpriority(pid) != NPRIO-1){
+    printf("%s: priority of child not set\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  wait(0);
+  if(getpriority(pid) != -1){
+    printf("%s: getpriority of dead child succeeded\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// deadline class: argument checks, and admission control
+// refusing more than the CPUs can carry.
+void
+deadline(char *s)
+{
+  int up[2], down[2], i, r, refused;
+  char c;
+
+  if(setdeadline(2, 4, 1) != -1 || setdeadline(1, 2, 4) != -1 ||
+     dlyield() != -1){
+    printf("%s: bad deadline arguments accepted\n", s);
+    exit(1);
+  }
+  if(pipe(up) < 0 || pipe(down) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  // each child asks for a whole CPU, and holds it
+  // while blocked in read().
+  for(i = 0; i < NCPU+1; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(up[0]);
+      close(down[1]);
+      r = setdeadline(1, 1, 1);
+      write(up[1], &r, sizeof(r));
+      read(down[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(up[1]);
+  close(down[0]);
+  refused = 0;
+  for(i = 0; i < NCPU+1; i++){
+    if(read(up[0], &r, sizeof(r)) != sizeof(r)){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    if(r < 0)
+      refused++;
+  }
+  close(down[1]);
+  close(up[0]);
+  for(i = 0; i < NCPU+1; i++)
+    wait(0);
+  if(refused == 0){
+    printf("%s: admitted more than NCPU CPUs of work\n", s);
+    exit(1);
+  }
+  // the children's utilization is released at exit.
+  if(setdeadline(1, 2, 2) < 0){
+    printf("%s: setdeadline failed\n", s);
+    exit(1);
+  }
+  if(dlyield() < 0 || setdeadline(0, 0, 0) < 0){
+    printf("%s: dlyield failed\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// affinity masks: checked, kept, and inherited by fork.
+void
+affinity(char *s)
+{
+  int pid, xstatus;
+
+  if(setaffinity(getpid(), 0) != -1 || getaffinity(-1) != -1){
+    printf("%s: bad affinity arguments accepted\n", s);
+    exit(1);
+  }
+  if(setaffinity(getpid(), 1) < 0 || getaffinity(getpid()) != 1){
+    printf("%s: affinity not set\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(getaffinity(getpid()) == 1 ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child did not inherit affinity\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// threads share memory, and leave with the process.
+struct umutex threadlock;
+int threadcount;
+
+void
+threadadd(void *arg)
+{
+  for(int i = 0; i < 1000; i++){
+    umutex_lock(&threadlock);
+    threadcount += (uint64)arg;
+    umutex_unlock(&threadlock);
+  }
+}
+
+void
+threadspin(void *arg)
+{
+  for(;;)
+    ;
+}
+
+void
+threads(char *s)
+{
+  struct uthread t[4];
+  int i, pid, xstatus;
+
+  umutex_init(&threadlock);
+  threadcount = 0;
+  for(i = 0; i < 4; i++){
+    if(uthread_create(&t[i], threadadd, (void*)1) < 0){
+      printf("%s: uthread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < 4; i++){
+    if(uthread_join(&t[i]) < 0){
+      printf("%s: uthread_join failed\n", s);
+      exit(1);
+    }
+  }
+  if(threadcount != 4000){
+    printf("%s: count %d, not 4000\n", s, threadcount);
+    exit(1);
+  }
+  if(join(t[0].tid) != -1 || wait(0) != -1){
+    printf("%s: joined a thread twice\n", s);
+    exit(1);
+  }
+
+  // exit() must end a process's other threads.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(uthread_create(&t[0], threadspin, 0) < 0)
+      exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: uthread_create failed in child\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// threads share open files and the working directory.
+int threadfd;
+
+void
+threadopen(void *arg)
+{
+  if(chdir("threaddir") < 0)
+    return;
+  threadfd = open("inside", O_CREATE|O_RDWR);
+}
+
+void
+threadfiles(char *s)
+{
+  struct uthread t;
+  int fd;
+
+  if(mkdir("threaddir") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  threadfd = -1;
+  if(uthread_create(&t, threadopen, 0) < 0 || uthread_join(&t) < 0){
+    printf("%s: thread failed\n", s);
+    exit(1);
+  }
+  if(threadfd < 0 || write(threadfd, "x", 1) != 1 || close(threadfd) != 0){
+    printf("%s: file opened by a thread not shared\n", s);
+    exit(1);
+  }
+  if((fd = open("inside", O_RDONLY)) < 0){
+    printf("%s: chdir() by a thread not shared\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(chdir("..") < 0 || unlink("threaddir/inside") < 0 || unlink("threaddir") < 0){
+    printf("%s: cleanup failed\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// futex() checks its word, and condition variables built
+// on it hand off between threads.
+struct ucond futexcond;
+int futexflag;
+
+void
+futexwaiter(void *arg)
+{
+  umutex_lock(&threadlock);
+  while(futexflag == 0)
+    ucond_wait(&futexcond, &threadlock);
+  futexflag = 2;
+  umutex_unlock(&threadlock);
+}
+
+void
+futexes(char *s)
+{
+  struct uthread t;
+  int word = 1;
+
+  if(futex(&word, FUTEX_WAIT, 0) != -1 || futex(&word, FUTEX_WAKE, 1) != 0 ||
+     futex((int*)((char*)&word + 1), FUTEX_WAKE, 1) != -1){
+    printf("%s: futex misbehaved\n", s);
+    exit(1);
+  }
+  umutex_init(&threadlock);
+  ucond_init(&futexcond);
+  futexflag = 0;
+  if(uthread_create(&t, futexwaiter, 0) < 0){
+    printf("%s: uthread_create failed\n", s);
+    exit(1);
+  }
+  sleep(1);
+  umutex_lock(&threadlock);
+  futexflag = 1;
+  ucond_signal(&futexcond);
+  umutex_unlock(&threadlock);
+  if(uthread_join(&t) < 0 || futexflag != 2){
+    printf("%s: waiter did not run\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// nanosleep() for less than a tick, timed by clock_gettime().
+void
+hrtimer(char *s)
+{
+  struct timespec req, t0, t1;
+  uint64 ns;
+
+  req.sec = 0;
+  req.nsec = 1000000000;
+  if(nanosleep(&req) != -1 || clock_gettime(0, &t0) != -1){
+    printf("%s: bad time arguments accepted\n", s);
+    exit(1);
+  }
+  req.nsec = 2000000;  // 2ms
+  if(clock_gettime(CLOCK_MONOTONIC, &t0) < 0 || nanosleep(&req) < 0 ||
+     clock_gettime(CLOCK_MONOTONIC, &t1) < 0){
+    printf("%s: nanosleep failed\n", s);
+    exit(1);
+  }
+  ns = (t1.sec - t0.sec) * 1000000000 + t1.nsec - t0.nsec;
+  if(ns < req.nsec){
+    printf("%s: slept %dus, not 2000us\n", s, (int)(ns / 1000));
+    exit(1);
+  }
+  exit(0);
+}
+
+// getrusage() and times() should charge user-space spinning
+// to utime, a sleep to nvcsw, and a waited-for child's usage
+// to RUSAGE_CHILDREN.
+void
+rusage(char *s)
+{
+  struct rusage r0, r1;
+  struct tms tms;
+  int pid, t;
+
+  if(getrusage(2, &r0) != -1){
+    printf("%s: bad who accepted\n", s);
+    exit(1);
+  }
+  if(getrusage(RUSAGE_SELF, &r0) < 0){
+    printf("%s: getrusage failed\n", s);
+    exit(1);
+  }
+  t = uptime();
+  while(uptime() < t + 2)
+    ;
+  sleep(1);
+  if(getrusage(RUSAGE_SELF, &r1) < 0){
+    printf("%s: getrusage failed\n", s);
+    exit(1);
+  }
+  if(r1.ru_utime <= r0.ru_utime || r1.ru_nvcsw <= r0.ru_nvcsw){
+    printf("%s: spinning and sleeping not accounted\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    t = uptime();
+    while(uptime() < t + 2)
+      ;
+    exit(0);
+  }
+  wait(0);
+  if(getrusage(RUSAGE_CHILDREN, &r1) < 0 || times(&tms) < 0){
+    printf("%s: getrusage failed\n", s);
+    exit(1);
+  }
+  if(r1.ru_utime == 0 || tms.tms_cutime != r1.ru_utime){
+    printf("%s: child's usage not accounted\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// with tracing on, a child's fork, first run and exit
+// should show up in tracedrain().
+struct traceev tracebuf[NCPU * NTRACE];
+
+void
+tracing(char *s)
+{
+  int pid, n, i, seen = 0;
+
+  trace(1);
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(0);
+  wait(0);
+  trace(0);
+  n = tracedrain(tracebuf, NCPU * NTRACE);
+  if(n < 0){
+    printf("%s: tracedrain failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(tracebuf[i].type == TR_FORK && tracebuf[i].arg == pid)
+      seen |= 1;
+    if(tracebuf[i].type == TR_SWITCHIN && tracebuf[i].pid == pid)
+      seen |= 2;
+    if(tracebuf[i].type == TR_EXIT && tracebuf[i].pid == pid)
+      seen |= 4;
+  }
+  if(seen != 7){
+    printf("%s: missing events for pid %d\n", s, pid);
+    exit(1);
+  }
+  exit(0);
+}
+
+// with profiling on, ticks should catch a spinning
+// process in user space.
+struct profsample profbuf[64];
+
+void
+profile(char *s)
+{
+  int n, i, t, pid = getpid();
+
+  prof(1);
+  t = uptime();
+  while(uptime() < t + 3)
+    ;
+  prof(0);
+  n = profdrain(profbuf, sizeof(profbuf) / sizeof(profbuf[0]));
+  if(n < 0){
+    printf("%s: profdrain failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < n; i++)
+    if(profbuf[i].pid == pid && profbuf[i].user)
+      exit(0);
+  printf("%s: no user samples in %d\n", s, n);
+  exit(1);
+}
+
+uint64
+freepages(char *s)
+{
+  struct memstat st;
+  uint64 n;
+  int k;
+
+  if(memstat(&st) < 0){
+    printf("%s: memstat failed\n", s);
+    exit(1);
+  }
+  n = st.cached;
+  for(k = 0; k < NORDER; k++)
+    n += st.nfree[k] << k;
+  if(n > st.total){
+    printf("%s: %l pages free of %l\n", s, n, st.total);
+    exit(1);
+  }
+  return n;
+}
+
+// memstat() should see pages leave and come back to the
+// allocator as the process grows and shrinks.
+void
+buddy(char *s)
+{
+  uint64 n0, n1, n2;
+  int n = 64, i;
+  char *a;
+
+  n0 = freepages(s);
+  if((a = sbrk(n * PGSIZE)) == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  // sbrk() is lazy: touch the pages so they are taken.
+  for(i = 0; i < n; i++)
+    a[i * PGSIZE] = 1;
+  n1 = freepages(s);
+  sbrk(-n * PGSIZE);
+  n2 = freepages(s);
+  if(n0 - n1 < n || n2 - n1 < n){
+    printf("%s: free pages %l, %l, %l\n", s, n0, n1, n2);
+    exit(1);
+  }
+  exit(0);
+}
+
+// open files are allocated from a slab cache, so there
+// should be room for more than the old table's 100.
+void
+manyfiles(char *s)
+{
+  enum { N = 12 };
+  int ready[2], go[2], i, j, pid, xstatus;
+  char c;
+
+  if(pipe(ready) < 0 || pipe(go) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(ready[0]);
+      close(go[1]);
+      for(j = 0; j < NOFILE - 5; j++){
+        if(open("README", O_RDONLY) < 0){
+          printf("%s: open failed\n", s);
+          exit(1);
+        }
+      }
+      // hold them open until every child has its files.
+      write(ready[1], "x", 1);
+      read(go[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(ready[1]);
+  close(go[0]);
+  for(i = 0; i < N; i++)
+    if(read(ready[0], &c, 1) != 1)
+      break;
+  close(go[1]);
+  close(ready[0]);
+  for(j = 0; j < N; j++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  if(i < N){
+    printf("%s: only %d children opened their files\n", s, i);
+    exit(1);
+  }
+  exit(0);
+}
+
+// fork should share the parent's memory copy-on-write:
+// the child's stores, and read()s into its memory, must
+// not show in the parent, and forking a big heap should
+// not use up a page per heap page.
+void
+cowfork(char *s)
+{
+  enum { N = 512 };  // heap pages
+  char *heap, c;
+  int fds[2], i, pid, xstatus;
+  uint64 before, after;
+
+  heap = sbrk(N * PGSIZE);
+  if(heap == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++)
+    heap[i * PGSIZE] = 'p';
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+
+  before = freepages(s);
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // wait for the parent to measure, then read into the heap.
+    close(fds[1]);
+    if(read(fds[0], &heap[PGSIZE], 1) != 1 || heap[PGSIZE] != 'c')
+      exit(1);
+    for(i = 0; i < N; i += 2)
+      heap[i * PGSIZE] = 'c';
+    for(i = 0; i < N; i++)
+      if(heap[i * PGSIZE] != (i % 2 == 0 || i == 1 ? 'c' : 'p'))
+        exit(1);
+    exit(0);
+  }
+  close(fds[0]);
+  after = freepages(s);
+  c = 'c';
+  write(fds[1], &c, 1);
+  close(fds[1]);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong memory\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(heap[i * PGSIZE] != 'p'){
+      printf("%s: child's store showed in parent\n", s);
+      exit(1);
+    }
+  }
+  if(before - after > N / 2){
+    printf("%s: fork used %l pages\n", s, before - after);
+    exit(1);
+  }
+  exit(0);
+}
+
+// exec() reads a program's pages in from its file as they
+// are touched: check that initialized data and text come
+// in right, in the process and in a forked child, and that
+// the kernel won't write into text it shares.
+char lazydata[4*4096] = { [0] = 'a', [4096] = 'b', [3*4096 + 7] = 'c' };
+
+void
+lazyexec(char *s)
+{
+  int pid, xstatus, fd;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(lazydata[0] != 'a' || lazydata[4096] != 'b' ||
+       lazydata[3*4096 + 7] != 'c' || lazydata[2*4096] != 0)
+      exit(1);
+    lazydata[4096] = 'x';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child read wrong data\n", s);
+    exit(1);
+  }
+  if(lazydata[4096] != 'b' || lazydata[3*4096 + 7] != 'c'){
+    printf("%s: parent read wrong data\n", s);
+    exit(1);
+  }
+  fd = open("README", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  if(read(fd, (char*)lazyexec, 8) != -1){
+    printf("%s: read into text succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  exit(0);
+}
+
+// a system call must be able to read in a program page
+// it copies to or from with a lock held: write a never
+// touched static buffer into a pipe, and read it back into
+// another.
+char coldsrc[2*4096] = { [4096] = 'p', [4096 + 99] = 'q' };
+char colddst[2*4096] = { [0] = 1 };
+
+void
+lazypipe(char *s)
+{
+  int fds[2];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], coldsrc + 4096, 100) != 100){
+    printf("%s: write from untouched data failed\n", s);
+    exit(1);
+  }
+  if(read(fds[0], colddst + 4096, 100) != 100){
+    printf("%s: read into untouched data failed\n", s);
+    exit(1);
+  }
+  if(colddst[4096] != 'p' || colddst[4096 + 99] != 'q'){
+    printf("%s: wrong data through pipe\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  exit(0);
+}
+
+// sbrk() should only reserve memory: pages are allocated
+// when first touched, by the process or by a system call
+// writing into them, and freed again by a negative sbrk().
+void
+lazysbrk(char *s)
+{
+  enum { BIG = 64*1024*1024 };
+  uint64 n0, n1, n2, n3;
+  char *a;
+  int fd;
+
+  n0 = freepages(s);
+  a = sbrk(BIG);
+  if(a == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  n1 = freepages(s);
+  a[0] = 1;
+  a[BIG - 1] = 1;
+  fd = open("README", O_RDONLY);
+  if(fd < 0 || read(fd, a + BIG/2, 10) != 10){
+    printf("%s: read into untouched memory failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(a[BIG/4] != 0){
+    printf("%s: untouched memory not zero\n", s);
+    exit(1);
+  }
+  n2 = freepages(s);
+  sbrk(-BIG);
+  n3 = freepages(s);
+  if(n0 - n1 > 16 || n1 - n2 > 16 || n1 - n2 < 4 || n3 - n2 < 4){
+    printf("%s: free pages %l, %l, %l, %l\n", s, n0, n1, n2, n3);
+    exit(1);
+  }
+  exit(0);
+}
+
+// mmap() of files, private and shared, and of anonymous
+// memory: contents, write-back on munmap() and on exit,
+// sharing with a forked child, partial munmap(), and
+// reuse of the space munmap() frees.
+void
+mmaptest(char *s)
+{
+  enum { SZ = 2*4096 + 100 };  // fits in buf
+  char *p, *q = 0, *top;
+  int fd, i, pid, xstatus;
+
+  unlink("mmapfile");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 251;
+  if(fd < 0 || write(fd, buf, SZ) != SZ){
+    printf("%s: create mmapfile failed\n", s);
+    exit(1);
+  }
+
+  // private: the file's contents, zeroes after, and
+  // stores that stay in the process.
+  p = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED){
+    printf("%s: mmap private failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    if(p[i] != (char)(i % 251)){
+      printf("%s: wrong byte %d in private mapping\n", s, i);
+      exit(1);
+    }
+  if(p[SZ] != 0){
+    printf("%s: byte past end of file not zero\n", s);
+    exit(1);
+  }
+  p[0] = 'x';
+  if(munmap(p, SZ) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  // shared: stores reach the file on munmap(), and on
+  // exit in a child.
+  p = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED){
+    printf("%s: mmap shared failed\n", s);
+    exit(1);
+  }
+  p[1] = 'y';
+  // only the second page goes; the first must still work.
+  if(munmap(p + 4096, 4096) < 0 || p[1] != 'y' || p[2] != 2){
+    printf("%s: partial munmap failed\n", s);
+    exit(1);
+  }
+  munmap(p, SZ);
+  pid = fork();
+  if(pid == 0){
+    p = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED)
+      exit(1);
+    p[SZ - 1] = 'z';
+    exit(0);
+  }
+  wait(&xstatus);
+  close(fd);
+  fd = open("mmapfile", O_RDONLY);
+  if(xstatus != 0 || fd < 0 || read(fd, buf, SZ) != SZ ||
+     buf[0] != 0 || buf[1] != 'y' || buf[SZ - 1] != 'z'){
+    printf("%s: shared stores not written back\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapfile");
+
+  // anonymous shared memory is shared with a child, even
+  // pages neither touched before the fork.
+  p = mmap(0, 2*4096, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED){
+    printf("%s: mmap anonymous failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid == 0){
+    p[10] = 'w';
+    while(((volatile char*)p)[4096+10] != 'p')
+      ;
+    exit(0);
+  }
+  p[4096+10] = 'p';
+  wait(&xstatus);
+  if(xstatus != 0 || p[10] != 'w'){
+    printf("%s: anonymous memory not shared\n", s);
+    exit(1);
+  }
+  munmap(p, 2*4096);
+
+  // regions leave the heap alone, munmap()ed space is
+  // used again, and touching it meanwhile is a fault.
+  top = sbrk(0);
+  for(i = 0; i < 100; i++){
+    p = mmap(0, 4*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED || (q && p != q)){
+      printf("%s: munmap()ed space not reused\n", s);
+      exit(1);
+    }
+    p[4096] = 1;
+    munmap(p, 4*4096);
+    q = p;
+  }
+  if(sbrk(0) != top){
+    printf("%s: mmap() grew the heap\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid == 0){
+    q[4096] = 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: store to unmapped memory succeeded\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// cat writes a file into a pipe straight from where it
+// maps it, so its pages are read in as the pipe copies
+// them: run cat catpipe | wc > catpipe-out on a cold file.
+void
+catpipe(char *s)
+{
+  char *catargv[] = { "cat", "catpipe", 0 };
+  char *wcargv[] = { "wc", 0 };
+  char *want = "2000 2000 10000 \n";
+  int fd, fds[2], i, xstatus;
+
+  unlink("catpipe");
+  fd = open("catpipe", O_CREATE|O_WRONLY);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2000; i++)
+    if(write(fd, "mmap\n", 5) != 5){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  close(fd);
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(fork() == 0){
+    close(1);
+    dup(fds[1]);
+    close(fds[0]);
+    close(fds[1]);
+    exec("cat", catargv);
+    exit(1);
+  }
+  if(fork() == 0){
+    close(0);
+    dup(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+    close(1);
+    if(open("catpipe-out", O_CREATE|O_TRUNC|O_WRONLY) != 1)
+      exit(1);
+    exec("wc", wcargv);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i < 2; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: cat or wc failed\n", s);
+      exit(1);
+    }
+  }
+
+  fd = open("catpipe-out", O_RDONLY);
+  i = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  unlink("catpipe");
+  unlink("catpipe-out");
+  if(i < 0)
+    i = 0;
+  buf[i] = 0;
+  if(strcmp(buf, want) != 0){
+    printf("%s: wc printed %s", s, buf);
+    exit(1);
+  }
+  exit(0);
+}
+
 struct test {
   void (*f)(char *);
   char *s;
@@ -2627,6 +3594,7 @@ struct test {
   {validatetest, "validatetest"},
   {bsstest, "bsstest"},
   {bigargtest, "bigargtest"},
+  {longargtest, "longargtest"},
   {argptest, "argptest"},
   {stacktest, "stacktest"},
   {textwrite, "textwrite"},
@@ -2635,6 +3603,24 @@ struct test {
   {sbrklast, "sbrklast"},
   {sbrk8000, "sbrk8000"},
   {badarg, "badarg" },
+  {priority, "priority" },
+  {deadline, "deadline" },
+  {affinity, "affinity" },
+  {threads, "threads" },
+  {threadfiles, "threadfiles" },
+  {futexes, "futexes" },
+  {hrtimer, "hrtimer" },
+  {rusage, "rusage" },
+  {tracing, "tracing" },
+  {profile, "profile" },
+  {buddy, "buddy" },
+  {manyfiles, "manyfiles" },
+  {cowfork, "cowfork" },
+  {lazysbrk, "lazysbrk" },
+  {lazyexec, "lazyexec" },
+  {lazypipe, "lazypipe" },
+  {mmaptest, "mmap" },
+  {catpipe, "catpipe" },
 
   { 0, 0},
 };
@@ -3010,8 +3996,11 @@ countfree()
         break;
       }
 
-      // modify the memory to make sure it's really allocated.
-      *(char *)(a + 4096 - 1) = 1;
+      // sbrk() only reserves the page. have memstat() copy out
+      // into it, which allocates it, or fails once memory runs
+      // out, where a store would fault and kill the child.
+      if(memstat((struct memstat*)a) < 0)
+        break;
 
       // report back one more page.
       if(write(fds[1], "x", 1) != 1){
@@ -36,3 +36,25 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("cpustat");
+entry("setpriority");
+entry("getpriority");
+entry("settickets");
+entry("setdeadline");
+entry("dlyield");
+entry("setaffinity");
+entry("getaffinity");
+entry("clone");
+entry("join");
+entry("futex");
+entry("nanosleep");
+entry("clock_gettime");
+entry("getrusage");
+entry("times");
+entry("trace");
+entry("tracedrain");
+entry("prof");
+entry("profdrain");
+entry("memstat");
+entry("mmap");
+entry("munmap");
@@ -0,0 +1,122 @@
+#include "kernel/types.h"
+#include "user/user.h"
+#include "kernel/futex.h"
+#include "user/uthread.h"
+
+#define STACKSIZE 8192
+
+// malloc() is not safe to call from two threads at once.
+static struct umutex malloclock;
+
+// A new thread starts here, on its own stack.
+static void
+start(void *arg)
+{
+  struct uthread *t = arg;
+
+  t->fn(t->arg);
+  exit(0);
+}
+
+// Start a thread running fn(arg). t must stay valid
+// until the thread has been joined.
+int
+uthread_create(struct uthread *t, void (*fn)(void*), void *arg)
+{
+  uint64 sp;
+
+  umutex_lock(&malloclock);
+  t->stack = malloc(STACKSIZE);
+  umutex_unlock(&malloclock);
+  if(t->stack == 0)
+    return -1;
+  t->fn = fn;
+  t->arg = arg;
+  sp = (uint64)(t->stack + STACKSIZE) & ~15L;
+  if((t->tid = clone(start, t, (void*)sp)) < 0){
+    umutex_lock(&malloclock);
+    free(t->stack);
+    umutex_unlock(&malloclock);
+    return -1;
+  }
+  return 0;
+}
+
+// Wait for thread t to finish, and free its stack.
+int
+uthread_join(struct uthread *t)
+{
+  if(join(t->tid) < 0)
+    return -1;
+  umutex_lock(&malloclock);
+  free(t->stack);
+  umutex_unlock(&malloclock);
+  return 0;
+}
+
+void
+umutex_init(struct umutex *m)
+{
+  m->locked = 0;
+}
+
+// An uncontended lock or unlock is one atomic
+// instruction. A thread that has to wait marks the
+// mutex contended (2), so the unlock knows to wake it.
+void
+umutex_lock(struct umutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->locked, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->locked, 2);
+  while(c != 0){
+    futex(&m->locked, FUTEX_WAIT, 2);
+    c = __sync_lock_test_and_set(&m->locked, 2);
+  }
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+  if(__sync_fetch_and_sub(&m->locked, 1) != 1){
+    __sync_lock_release(&m->locked);
+    futex(&m->locked, FUTEX_WAKE, 1);
+  }
+}
+
+void
+ucond_init(struct ucond *c)
+{
+  c->seq = 0;
+}
+
+// Release m, wait for a signal, and reacquire m.
+// Wakeups may be spurious, so callers recheck.
+void
+ucond_wait(struct ucond *c, struct umutex *m)
+{
+  int seq = c->seq;
+
+  umutex_unlock(m);
+  // a signal since seq was read changes it, and
+  // futex() then returns at once.
+  futex(&c->seq, FUTEX_WAIT, seq);
+  umutex_lock(m);
+}
+
+void
+ucond_signal(struct ucond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+ucond_broadcast(struct ucond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, 0x7fffffff);
+}
@@ -0,0 +1,28 @@
+// Threads on clone() and join(), with mutexes and
+// condition variables that sleep in futex() only when
+// they have to wait.
+
+struct uthread {
+  int tid;
+  void (*fn)(void*);
+  void *arg;
+  char *stack;
+};
+
+struct umutex {
+  int locked;  // 0 free, 1 held, 2 held with waiters
+};
+
+struct ucond {
+  int seq;  // bumped by every signal
+};
+
+int uthread_create(struct uthread*, void (*)(void*), void*);
+int uthread_join(struct uthread*);
+void umutex_init(struct umutex*);
+void umutex_lock(struct umutex*);
+void umutex_unlock(struct umutex*);
+void ucond_init(struct ucond*);
+void ucond_wait(struct ucond*, struct umutex*);
+void ucond_signal(struct ucond*);
+void ucond_broadcast(struct ucond*);
@@ -0,0 +1,110 @@
+// Wakeup latency benchmark: one process sleeps in read()
+// on a pipe, another writes the time into the pipe, and
+// the sleeper measures how long it took to run again.
+// CPU-bound hogs keep the other CPUs busy, so the sleeper
+// has to preempt one of them when it wakes.
+//
+//   wakelat [hogs [rounds]]    (default 2 hogs, 100 rounds)
+//
+// Times are in cycles of the time CSR, 10 per microsecond
+// on qemu's virt machine.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+static uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("csrr %0, time" : "=r" (x));
+  return x;
+}
+
+void
+hog(void)
+{
+  for(;;)
+    ;
+}
+
+void
+sleeper(int in, int out)
+{
+  uint64 t0, lat;
+
+  while(read(in, &t0, sizeof(t0)) == sizeof(t0)){
+    lat = rdtime() - t0;
+    write(out, &lat, sizeof(lat));
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nhog = 2, rounds = 100;
+  int hogs[64], to[2], from[2], i, pid;
+  uint64 t0, lat, min = -1, max = 0, total = 0;
+
+  if(argc > 1)
+    nhog = atoi(argv[1]);
+  if(argc > 2)
+    rounds = atoi(argv[2]);
+  if(nhog < 0 || nhog > 64 || rounds < 1){
+    fprintf(2, "usage: wakelat [hogs [rounds]]\n");
+    exit(1);
+  }
+
+  if(pipe(to) < 0 || pipe(from) < 0){
+    fprintf(2, "wakelat: pipe failed\n");
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    fprintf(2, "wakelat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(to[1]);
+    close(from[0]);
+    sleeper(to[0], from[1]);
+  }
+  close(to[0]);
+  close(from[1]);
+
+  for(i = 0; i < nhog; i++){
+    if((hogs[i] = fork()) < 0){
+      fprintf(2, "wakelat: fork failed\n");
+      exit(1);
+    }
+    if(hogs[i] == 0)
+      hog();
+  }
+
+  for(i = 0; i < rounds; i++){
+    // give the sleeper time to block in read().
+    sleep(1);
+    t0 = rdtime();
+    write(to[1], &t0, sizeof(t0));
+    if(read(from[0], &lat, sizeof(lat)) != sizeof(lat)){
+      fprintf(2, "wakelat: read failed\n");
+      exit(1);
+    }
+    total += lat;
+    if(lat < min)
+      min = lat;
+    if(lat > max)
+      max = lat;
+  }
+  close(to[1]);
+  close(from[0]);
+
+  for(i = 0; i < nhog; i++)
+    kill(hogs[i]);
+  for(i = 0; i < nhog + 1; i++)
+    wait(0);
+
+  printf("wakelat: %d hogs, %d rounds: min %l avg %l max %l cycles\n",
+         nhog, rounds, min, total / rounds, max);
+  exit(0);
+}